@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "android.hardware.light-vibrator-service.onclite"
+
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <log/log.h>
+
+#include "Lights.h"
+#include "Vibrator.h"
+
+using ::aidl::android::hardware::light::Lights;
+using ::aidl::android::hardware::vibrator::Vibrator;
+
+/*
+ * Hosts the light and vibrator HALs in one process, sharing a binder thread
+ * pool. Both keep their own worker thread for sysfs writes.
+ */
+int main() {
+    ABinderProcess_setThreadPoolMaxThreadCount(2);
+
+    std::shared_ptr<Lights> lights = ndk::SharedRefBase::make<Lights>();
+    std::shared_ptr<Vibrator> vibrator = ndk::SharedRefBase::make<Vibrator>();
+
+    const std::string lightsInstance = std::string() + Lights::descriptor + "/default";
+    binder_status_t status =
+            AServiceManager_addService(lights->asBinder().get(), lightsInstance.c_str());
+    if (status != STATUS_OK) {
+        ALOGE("Cannot register Lights HAL service.");
+        return 1;
+    }
+
+    const std::string vibratorInstance = std::string() + Vibrator::descriptor + "/default";
+    status = AServiceManager_addService(vibrator->asBinder().get(), vibratorInstance.c_str());
+    if (status != STATUS_OK) {
+        ALOGE("Cannot register Vibrator HAL service.");
+        return 1;
+    }
+
+    ALOGI("Lights and Vibrator HAL services ready.");
+
+    ABinderProcess_joinThreadPool();
+
+    return 1;
+}
@@ -243,8 +243,14 @@ PRODUCT_PACKAGES += \
     android.hardware.keymaster@4.1.vendor
 
 # Lights
+# Set TARGET_USES_COMBINED_LIGHT_VIBRATOR to host the light and vibrator HALs in one process.
+ifeq ($(TARGET_USES_COMBINED_LIGHT_VIBRATOR),true)
 PRODUCT_PACKAGES += \
-    android.hardware.light@2.0-service.onclite
+    android.hardware.light-vibrator-service.onclite
+else
+PRODUCT_PACKAGES += \
+    android.hardware.light-service.onclite
+endif
 
 # LiveDisplay
 PRODUCT_PACKAGES += \
@@ -380,8 +386,10 @@ PRODUCT_PACKAGES += \
 
 # Vibrator
 TARGET_USES_DEVICE_SPECIFIC_VIBRATOR := true
+ifneq ($(TARGET_USES_COMBINED_LIGHT_VIBRATOR),true)
 PRODUCT_PACKAGES += \
-    android.hardware.vibrator@1.3-service.xiaomi_onclite
+    android.hardware.vibrator-service.xiaomi_onclite
+endif
 
 # Whitelisted app
 PRODUCT_COPY_FILES += \
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LightService"
+
+#include <log/log.h>
+
+#include "LedRegistry.h"
+
+#include <dirent.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#define UEVENT_MSG_LEN  2048
+
+namespace {
+
+static bool exists(const std::string& path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+static uint32_t readValue(const std::string& path) {
+    std::ifstream file(path);
+    uint32_t value = 0;
+
+    if (!file.is_open()) {
+        ALOGW("failed to read from %s", path.c_str());
+        return 0;
+    }
+
+    file >> value;
+    return value;
+}
+
+/*
+ * Parse the space separated trigger list, the active one is wrapped in brackets.
+ */
+static std::vector<std::string> getTriggers(const std::string& path) {
+    std::ifstream file(path);
+    std::vector<std::string> triggers;
+    std::string trigger;
+
+    while (file >> trigger) {
+        if (trigger.front() == '[' && trigger.back() == ']') {
+            trigger = trigger.substr(1, trigger.size() - 2);
+        }
+        triggers.push_back(trigger);
+    }
+
+    return triggers;
+}
+
+static LedInfo probeLed(const std::string& dir) {
+    LedInfo info;
+
+    info.maxBrightness = readValue(dir + "max_brightness");
+    info.hasBreath = exists(dir + "breath");
+    info.hasBlink = exists(dir + "delay_on") && exists(dir + "delay_off");
+    info.triggers = getTriggers(dir + "trigger");
+    info.hasPattern = exists(dir + "pattern") || info.hasTrigger("pattern");
+    info.hasHwPattern = exists(dir + "hw_pattern");
+
+    return info;
+}
+
+}  // anonymous namespace
+
+bool LedInfo::hasTrigger(const std::string& trigger) const {
+    return std::find(triggers.begin(), triggers.end(), trigger) != triggers.end();
+}
+
+void LedRegistry::probe() {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(root.c_str()), closedir);
+
+    leds.clear();
+
+    if (!dir) {
+        ALOGE("failed to open %s", root.c_str());
+        return;
+    }
+
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        std::string name(entry->d_name);
+        leds.emplace(name, probeLed(root + name + "/"));
+    }
+}
+
+const LedInfo* LedRegistry::find(const std::string& name) const {
+    auto it = leds.find(name);
+
+    return it != leds.end() ? &it->second : nullptr;
+}
+
+LedRegistry::~LedRegistry() {
+    stop();
+}
+
+void LedRegistry::watch(std::function<void()> onChange) {
+    stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stopFd < 0) {
+        ALOGE("failed to create uevent stop fd: %s", strerror(errno));
+        return;
+    }
+
+    ueventThread = std::thread(&LedRegistry::ueventLoop, this, std::move(onChange));
+}
+
+void LedRegistry::stop() {
+    uint64_t one = 1;
+
+    if (!ueventThread.joinable()) {
+        return;
+    }
+
+    if (TEMP_FAILURE_RETRY(write(stopFd, &one, sizeof(one))) < 0) {
+        ALOGE("failed to stop uevent thread: %s", strerror(errno));
+    }
+    ueventThread.join();
+
+    close(stopFd);
+    stopFd = -1;
+}
+
+void LedRegistry::ueventLoop(std::function<void()> onChange) {
+    struct sockaddr_nl addr = {};
+    char msg[UEVENT_MSG_LEN + 2];
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        ALOGE("failed to open uevent socket: %s", strerror(errno));
+        return;
+    }
+
+    addr.nl_family = AF_NETLINK;
+    addr.nl_pid = 0;
+    addr.nl_groups = 1;
+
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ALOGE("failed to bind uevent socket: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+
+    for (;;) {
+        struct pollfd fds[] = {
+            { fd, POLLIN, 0 },
+            { stopFd, POLLIN, 0 },
+        };
+
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) < 0) {
+            ALOGE("failed to poll uevent socket: %s", strerror(errno));
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+
+        ssize_t len = TEMP_FAILURE_RETRY(recv(fd, msg, UEVENT_MSG_LEN, MSG_DONTWAIT));
+        if (len <= 0) {
+            continue;
+        }
+
+        msg[len] = '\0';
+        msg[len + 1] = '\0';
+
+        /*
+         * The payload is a list of NUL terminated KEY=VALUE strings. Only
+         * add and remove matter: the kernel also sends a change event for
+         * every trigger write, and rescanning on those would feed back into
+         * our own writes.
+         */
+        bool isLed = false;
+        bool hotplug = false;
+        for (char* cp = msg; *cp; cp += strlen(cp) + 1) {
+            if (!strcmp(cp, "SUBSYSTEM=leds")) {
+                isLed = true;
+            } else if (!strcmp(cp, "ACTION=add") || !strcmp(cp, "ACTION=remove")) {
+                hotplug = true;
+            }
+        }
+
+        if (isLed && hotplug) {
+            onChange();
+        }
+    }
+
+    close(fd);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LedInfo {
+    uint32_t maxBrightness;
+    bool hasBreath;
+    bool hasBlink;
+    bool hasPattern;
+    bool hasHwPattern;
+    std::vector<std::string> triggers;
+
+    bool hasTrigger(const std::string& trigger) const;
+};
+
+/*
+ * Capabilities of the LED class devices found under the LED class root,
+ * /sys/class/leds/ on the device.
+ *
+ * The tree is scanned once by probe() and only rescanned when the kernel
+ * reports an LED class device being added or removed.
+ */
+class LedRegistry {
+  public:
+    explicit LedRegistry(const std::string& root) : root(root) {}
+    ~LedRegistry();
+
+    void probe();
+    const LedInfo* find(const std::string& name) const;
+
+    /* Invoke onChange from a listener thread whenever an LED is added or removed. */
+    void watch(std::function<void()> onChange);
+    /* Stop the listener thread, onChange is not invoked anymore once this returns. */
+    void stop();
+
+  private:
+    void ueventLoop(std::function<void()> onChange);
+
+    const std::string root;
+    std::map<std::string, LedInfo> leds;
+    std::thread ueventThread;
+    int stopFd = -1;
+};
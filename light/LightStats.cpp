@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LightStats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+void LatencyHistogram::record(int64_t ns) {
+    uint64_t us = ns > 0 ? ns / 1000 : 0;
+    size_t bucket = 0;
+
+    while (us && bucket < BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::dump(int fd) const {
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        uint64_t count = buckets[bucket].load(std::memory_order_relaxed);
+        if (!count) {
+            continue;
+        }
+
+        if (bucket == BUCKETS - 1) {
+            dprintf(fd, "      >= %6u us: %" PRIu64 "\n", 1u << (bucket - 1), count);
+        } else {
+            dprintf(fd, "      <  %6u us: %" PRIu64 "\n", 1u << bucket, count);
+        }
+    }
+}
+
+void TransitionLog::record(int32_t id, const HwLightState& state) {
+    uint64_t index = head.load(std::memory_order_relaxed);
+    Entry& entry = entries[index % ENTRIES];
+    uint32_t seq = entry.seq.load(std::memory_order_relaxed);
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    entry.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    entry.timeNs.store(ts.tv_sec * 1000000000LL + ts.tv_nsec, std::memory_order_relaxed);
+    entry.id.store(id, std::memory_order_relaxed);
+    entry.color.store(state.color, std::memory_order_relaxed);
+    entry.flashMode.store(static_cast<int32_t>(state.flashMode), std::memory_order_relaxed);
+    entry.flashOnMs.store(state.flashOnMs, std::memory_order_relaxed);
+    entry.flashOffMs.store(state.flashOffMs, std::memory_order_relaxed);
+
+    entry.seq.store(seq + 2, std::memory_order_release);
+    head.store(index + 1, std::memory_order_release);
+}
+
+void TransitionLog::dump(int fd) const {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > ENTRIES ? end - ENTRIES : 0;
+
+    for (uint64_t index = begin; index < end; index++) {
+        const Entry& entry = entries[index % ENTRIES];
+        uint32_t seq = entry.seq.load(std::memory_order_acquire);
+
+        int64_t timeNs = entry.timeNs.load(std::memory_order_relaxed);
+        int32_t id = entry.id.load(std::memory_order_relaxed);
+        int32_t color = entry.color.load(std::memory_order_relaxed);
+        int32_t flashMode = entry.flashMode.load(std::memory_order_relaxed);
+        int32_t flashOnMs = entry.flashOnMs.load(std::memory_order_relaxed);
+        int32_t flashOffMs = entry.flashOffMs.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        /* The applier has lapped us while we were reading. */
+        if ((seq & 1) || seq != entry.seq.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        dprintf(fd, "  %" PRId64 ".%03" PRId64 " id %d color 0x%08x flash %d on %d off %d\n",
+                timeNs / 1000000000, timeNs / 1000000 % 1000, id, color, flashMode,
+                flashOnMs, flashOffMs);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/light/HwLightState.h>
+#include <atomic>
+
+using ::aidl::android::hardware::light::HwLightState;
+
+/*
+ * Histogram of sysfs write latency, bucket n counts writes that took
+ * [2^(n-1), 2^n) microseconds and the last bucket everything slower.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr size_t BUCKETS = 16;
+
+    void record(int64_t ns);
+    void dump(int fd) const;
+
+  private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+};
+
+struct LightStats {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> errors{0};
+    LatencyHistogram latency;
+};
+
+/*
+ * The last resolved light states, written by the applier thread only and read
+ * by dump() without blocking it. Each entry is guarded by a sequence counter.
+ */
+class TransitionLog {
+  public:
+    static constexpr size_t ENTRIES = 32;
+
+    void record(int32_t id, const HwLightState& state);
+    void dump(int fd) const;
+
+  private:
+    struct Entry {
+        std::atomic<uint32_t> seq;
+        std::atomic<int64_t> timeNs;
+        std::atomic<int32_t> id;
+        std::atomic<int32_t> color;
+        std::atomic<int32_t> flashMode;
+        std::atomic<int32_t> flashOnMs;
+        std::atomic<int32_t> flashOffMs;
+    };
+
+    Entry entries[ENTRIES] = {};
+    std::atomic<uint64_t> head{0};
+};
@@ -0,0 +1,655 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LightService"
+
+#include <cutils/memory.h>
+#include <log/log.h>
+
+#include "Lights.h"
+#include "SysfsNode.h"
+
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#define LCD_LED_NAME    "lcd-backlight"
+#define WHITE_LED_NAME  "red"
+
+#define LCD_LED         LCD_LED_NAME "/"
+#define WHITE_LED       WHITE_LED_NAME "/"
+
+#define BREATH          "breath"
+#define BRIGHTNESS      "brightness"
+#define DELAY_OFF       "delay_off"
+#define DELAY_ON        "delay_on"
+#define PATTERN         "pattern"
+#define REPEAT          "repeat"
+#define TRIGGER         "trigger"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace light {
+
+namespace {
+
+/* Relative to the LED class root, opened by openNodes(). */
+static constexpr struct {
+    const char* name;
+    LightGroupId group;
+} nodeNames[NODE_COUNT] = {
+    { LCD_LED BRIGHTNESS, GROUP_BACKLIGHT },
+    { WHITE_LED BRIGHTNESS, GROUP_NOTIFICATION },
+    { WHITE_LED BREATH, GROUP_NOTIFICATION },
+    { WHITE_LED DELAY_OFF, GROUP_NOTIFICATION },
+    { WHITE_LED DELAY_ON, GROUP_NOTIFICATION },
+    { WHITE_LED TRIGGER, GROUP_NOTIFICATION },
+    { WHITE_LED PATTERN, GROUP_NOTIFICATION },
+    { WHITE_LED REPEAT, GROUP_NOTIFICATION },
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool reopen(LightNode& node, const std::string& path) {
+    /* The node may belong to a new device now, so forget what was written to it. */
+    node.shadowValid = false;
+    return node.file.open(path);
+}
+
+static uint32_t getBrightness(const HwLightState& state) {
+    uint32_t alpha, red, green, blue;
+
+    /*
+     * Extract brightness from AARRGGBB.
+     */
+    alpha = (state.color >> 24) & 0xFF;
+    red = (state.color >> 16) & 0xFF;
+    green = (state.color >> 8) & 0xFF;
+    blue = state.color & 0xFF;
+
+    /*
+     * Scale RGB brightness if Alpha brightness is not 0xFF.
+     */
+    if (alpha != 0xFF) {
+        red = red * alpha / 0xFF;
+        green = green * alpha / 0xFF;
+        blue = blue * alpha / 0xFF;
+    }
+
+    return (77 * red + 150 * green + 29 * blue) >> 8;
+}
+
+static inline uint32_t scaleBrightness(uint32_t brightness, uint32_t maxBrightness) {
+    return brightness * maxBrightness / 0xFF;
+}
+
+static inline uint32_t getScaledBrightness(const HwLightState& state, uint32_t maxBrightness) {
+    return scaleBrightness(getBrightness(state), maxBrightness);
+}
+
+/*
+ * Compile a blink program for the pattern trigger. Each tuple is a brightness
+ * and the time the kernel takes to move on to the next tuple, FlashMode::HARDWARE
+ * fades in and out while FlashMode::TIMED switches hard between on and off.
+ */
+static void compilePattern(const HwLightState& state, uint32_t brightness, char* pattern,
+                           size_t len) {
+    int32_t onMs = state.flashOnMs;
+    int32_t offMs = state.flashOffMs;
+
+    if (state.flashMode == FlashMode::HARDWARE) {
+        int32_t fadeMs = std::min(onMs, offMs) / 2;
+
+        snprintf(pattern, len, "0 %d %u %d %u %d 0 %d", fadeMs, brightness, onMs - fadeMs,
+                 brightness, fadeMs, offMs - fadeMs);
+    } else {
+        snprintf(pattern, len, "%u %d %u 0 0 %d 0 0", brightness, onMs, brightness, offMs);
+    }
+}
+
+static inline bool isLit(const HwLightState& state) {
+    return state.color & 0x00ffffff;
+}
+
+static constexpr size_t typeIndex(LightType type) {
+    return static_cast<size_t>(type);
+}
+
+static void publish(LightSlot& slot, const HwLightState& state) {
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+
+    /* An odd sequence means another writer owns the slot. */
+    do {
+        seq &= ~1u;
+    } while (!slot.seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed));
+
+    /* Keeps the data stores below from becoming visible before the odd sequence. */
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.color.store(static_cast<uint32_t>(state.color), std::memory_order_relaxed);
+    slot.flashMode.store(static_cast<int32_t>(state.flashMode), std::memory_order_relaxed);
+    slot.flashOnMs.store(state.flashOnMs, std::memory_order_relaxed);
+    slot.flashOffMs.store(state.flashOffMs, std::memory_order_relaxed);
+    slot.brightnessMode.store(static_cast<int32_t>(state.brightnessMode),
+                              std::memory_order_relaxed);
+
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+static HwLightState snapshot(const LightSlot& slot) {
+    HwLightState state;
+    uint32_t seq;
+
+    do {
+        seq = slot.seq.load(std::memory_order_acquire);
+
+        state.color = static_cast<int32_t>(slot.color.load(std::memory_order_relaxed));
+        state.flashMode = static_cast<FlashMode>(slot.flashMode.load(std::memory_order_relaxed));
+        state.flashOnMs = slot.flashOnMs.load(std::memory_order_relaxed);
+        state.flashOffMs = slot.flashOffMs.load(std::memory_order_relaxed);
+        state.brightnessMode =
+                static_cast<BrightnessMode>(slot.brightnessMode.load(std::memory_order_relaxed));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != slot.seq.load(std::memory_order_relaxed));
+
+    return state;
+}
+
+/* Types sharing one LED, sorted in the order of importance. */
+static constexpr LightType notificationChain[] = {
+    LightType::ATTENTION,
+    LightType::NOTIFICATIONS,
+    LightType::BATTERY,
+};
+
+static constexpr LightType backlightChain[] = {
+    LightType::BACKLIGHT,
+};
+
+struct LightGroup {
+    const LightType* chain;
+    size_t length;
+};
+
+/* Indexed by LightGroupId, handled by the matching entry of Lights::handlers. */
+static constexpr LightGroup groups[GROUP_COUNT] = {
+    { notificationChain, std::size(notificationChain) },
+    { backlightChain, std::size(backlightChain) },
+};
+
+static constexpr std::array<uint8_t, TYPE_COUNT> buildTypeGroups() {
+    std::array<uint8_t, TYPE_COUNT> typeGroups{};
+
+    for (uint8_t& group : typeGroups) {
+        group = GROUP_NONE;
+    }
+
+    for (size_t group = 0; group < GROUP_COUNT; group++) {
+        for (size_t i = 0; i < groups[group].length; i++) {
+            typeGroups[typeIndex(groups[group].chain[i])] = group;
+        }
+    }
+
+    return typeGroups;
+}
+
+/* The group each light type is handled by, or GROUP_NONE. */
+static constexpr std::array<uint8_t, TYPE_COUNT> typeGroups = buildTypeGroups();
+
+}  // anonymous namespace
+
+const LightStateHandler Lights::handlers[GROUP_COUNT] = {
+    &Lights::handleNotification,
+    &Lights::handleBacklight,
+};
+
+Lights::Lights(const std::string& root) : root(root), registry(root) {
+    for (LightSlot& slot : slots) {
+        slot.color = 0xff000000;
+    }
+
+    registry.probe();
+    updateGroups();
+    updateSupportedLights();
+    openNodes((1u << GROUP_COUNT) - 1);
+
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    applier = std::thread(&Lights::applyLoop, this);
+    registry.watch([this] { refresh(); });
+}
+
+Lights::~Lights() {
+    /* No more refreshes once this returns, so the applier is the last user of the nodes. */
+    registry.stop();
+
+    stopping = true;
+    wake();
+    applier.join();
+
+    close(wakeFd);
+}
+
+void Lights::refresh() {
+    uint32_t changed;
+
+    {
+        std::lock_guard<std::mutex> nodeGuard(nodeLock);
+
+        registry.probe();
+        changed = updateGroups();
+        if (!changed) {
+            return;
+        }
+
+        updateSupportedLights();
+        openNodes(changed);
+    }
+
+    /* Only the groups whose LED came or went have fresh nodes to bring up to date. */
+    pendingGroups.fetch_or(changed);
+    wake();
+}
+
+/* Returns the mask of groups whose LED appeared or went away. */
+uint32_t Lights::updateGroups() {
+    uint32_t changed = 0;
+    const LedInfo* info;
+
+    info = registry.find(LCD_LED_NAME);
+    lcdLed = info ? *info : LedInfo();
+    if (groupPresent[GROUP_BACKLIGHT].exchange(info != nullptr) != (info != nullptr)) {
+        changed |= 1u << GROUP_BACKLIGHT;
+    }
+
+    info = registry.find(WHITE_LED_NAME);
+    whiteLed = info ? *info : LedInfo();
+    if (groupPresent[GROUP_NOTIFICATION].exchange(info != nullptr) != (info != nullptr)) {
+        changed |= 1u << GROUP_NOTIFICATION;
+    }
+
+    return changed;
+}
+
+/* Open the nodes of the groups set in groupMask. */
+void Lights::openNodes(uint32_t groupMask) {
+    for (int id = 0; id < NODE_COUNT; id++) {
+        if (!(groupMask & (1u << nodeNames[id].group))) {
+            continue;
+        }
+        if (!reopen(nodes[id], root + nodeNames[id].name) && id != WHITE_PATTERN &&
+            id != WHITE_REPEAT) {
+            ALOGW("failed to open %s", nodes[id].file.path().c_str());
+        }
+    }
+}
+
+void Lights::updateSupportedLights() {
+    std::vector<HwLight> lights;
+
+    for (size_t group = 0; group < GROUP_COUNT; group++) {
+        if (!groupPresent[group]) {
+            continue;
+        }
+
+        for (size_t i = 0; i < groups[group].length; i++) {
+            HwLight light;
+
+            light.id = typeIndex(groups[group].chain[i]);
+            light.ordinal = 0;
+            light.type = groups[group].chain[i];
+            lights.push_back(light);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(lightsLock);
+    supportedLights = lights;
+}
+
+void Lights::wake() {
+    uint64_t one = 1;
+
+    if (TEMP_FAILURE_RETRY(write(wakeFd, &one, sizeof(one))) < 0) {
+        ALOGE("failed to wake applier: %s", strerror(errno));
+    }
+}
+
+ndk::ScopedAStatus Lights::setLightState(int32_t id, const HwLightState& state) {
+    size_t index = id;
+
+    /* If no group handles the id or its LED is missing, then the light is not supported. */
+    if (id < 0 || index >= TYPE_COUNT || typeGroups[index] == GROUP_NONE ||
+        !groupPresent[typeGroups[index]]) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    /*
+     * The applier thread picks up the latest state of the group, so requests
+     * arriving while it is busy writing collapse into one update.
+     */
+    stats[index].calls.fetch_add(1, std::memory_order_relaxed);
+    publish(slots[index], state);
+    pendingGroups.fetch_or(1u << typeGroups[index]);
+    wake();
+
+    return ndk::ScopedAStatus::ok();
+}
+
+bool Lights::isStaleStr(LightNodeId id, const char* value) const {
+    return !nodes[id].shadowValid || strcmp(nodes[id].shadow, value);
+}
+
+bool Lights::isStale(LightNodeId id, int64_t value) const {
+    char buf[24];
+
+    snprintf(buf, sizeof(buf), "%" PRId64, value);
+    return isStaleStr(id, buf);
+}
+
+void Lights::invalidate(LightNodeId id) {
+    nodes[id].shadowValid = false;
+}
+
+/*
+ * Write value to the cached node fd, reopening it once if the write fails.
+ * Writes of the value the node already holds are skipped. Returns false if the write failed.
+ */
+bool Lights::setStr(LightNodeId id, const char* value) {
+    LightNode& node = nodes[id];
+    int len = strlen(value);
+
+    int64_t startNs;
+    bool written;
+
+    if (!isStaleStr(id, value)) {
+        node.writesSkipped++;
+        if (activeStats) {
+            activeStats->skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    node.writesIssued++;
+    startNs = nowNs();
+
+    written = node.file.write(value, len);
+
+    if (activeStats) {
+        activeStats->writes.fetch_add(1, std::memory_order_relaxed);
+        activeStats->latency.record(nowNs() - startNs);
+        if (!written) {
+            activeStats->errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!written) {
+        ALOGW("failed to write %s to %s", value, node.file.path().c_str());
+        node.shadowValid = false;
+        return false;
+    }
+
+    strlcpy(node.shadow, value, sizeof(node.shadow));
+    node.shadowValid = true;
+    return true;
+}
+
+bool Lights::set(LightNodeId id, int64_t value) {
+    char buf[24];
+
+    snprintf(buf, sizeof(buf), "%" PRId64, value);
+    return setStr(id, buf);
+}
+
+void Lights::handleBacklight(LightType /* type */, const HwLightState& state) {
+    uint32_t brightness = getScaledBrightness(state, lcdLed.maxBrightness);
+    set(LCD_BRIGHTNESS, brightness);
+}
+
+const char* Lights::getBatteryTrigger() const {
+    static const char* const triggers[] = {
+        "battery-charging-or-full",
+        "battery-charging",
+    };
+
+    for (const char* trigger : triggers) {
+        if (whiteLed.hasTrigger(trigger)) {
+            return trigger;
+        }
+    }
+
+    return nullptr;
+}
+
+void Lights::setTrigger(const char* trigger) {
+    if (whiteLed.triggers.empty() || !isStaleStr(WHITE_TRIGGER, trigger)) {
+        return;
+    }
+
+    setStr(WHITE_TRIGGER, trigger);
+
+    /* Changing the trigger turns the LED off and recreates the trigger attributes. */
+    invalidate(WHITE_BRIGHTNESS);
+    invalidate(WHITE_DELAY_OFF);
+    invalidate(WHITE_DELAY_ON);
+    invalidate(WHITE_PATTERN);
+    invalidate(WHITE_REPEAT);
+}
+
+void Lights::stopBreath() {
+    /* Disable blinking, the driver leaves brightness undefined when it stops. */
+    if (whiteLed.hasBreath && isStale(WHITE_BREATH, 0)) {
+        set(WHITE_BREATH, 0);
+        invalidate(WHITE_BRIGHTNESS);
+    }
+}
+
+void Lights::handleNotification(LightType type, const HwLightState& state) {
+    uint32_t whiteBrightness = getScaledBrightness(state, whiteLed.maxBrightness);
+    bool blink = state.flashMode != FlashMode::NONE && state.flashOnMs > 0 && state.flashOffMs > 0;
+
+    /* Let the kernel run the whole blink program without waking us up again. */
+    if (blink && whiteBrightness && whiteLed.hasPattern) {
+        char pattern[PATTERN_LEN];
+
+        compilePattern(state, whiteBrightness, pattern, sizeof(pattern));
+
+        stopBreath();
+        setTrigger(PATTERN);
+
+        /*
+         * The trigger creates these attributes as root and ueventd only hands
+         * them over afterwards, so a write racing it fails. Blink in software
+         * then, the next update tries the trigger again.
+         */
+        if (set(WHITE_REPEAT, -1) && setStr(WHITE_PATTERN, pattern)) {
+            return;
+        }
+    }
+
+    /* Let the power supply drive the LED while charging. */
+    if (type == LightType::BATTERY && !blink && whiteBrightness && getBatteryTrigger()) {
+        stopBreath();
+        setTrigger(getBatteryTrigger());
+        return;
+    }
+
+    setTrigger("none");
+
+    if (!whiteLed.hasBreath || !whiteLed.hasBlink) {
+        set(WHITE_BRIGHTNESS, whiteBrightness);
+        return;
+    }
+
+    if (state.flashMode == FlashMode::TIMED) {
+        /* Blinking has to be restarted for new delays to take effect. */
+        if (isStale(WHITE_DELAY_OFF, state.flashOffMs) || isStale(WHITE_DELAY_ON, state.flashOnMs)) {
+            set(WHITE_BREATH, 0);
+        }
+
+        /* White */
+        set(WHITE_DELAY_OFF, state.flashOffMs);
+        set(WHITE_DELAY_ON, state.flashOnMs);
+
+        /* Enable blinking */
+        set(WHITE_BREATH, 1);
+    } else {
+        stopBreath();
+        set(WHITE_BRIGHTNESS, whiteBrightness);
+    }
+}
+
+/*
+ * Pick the highest priority lit state of a group, or the state of its most
+ * important type to turn the LED off when none is lit.
+ */
+HwLightState Lights::resolve(size_t group, LightType* type) const {
+    const LightGroup& chain = groups[group];
+    HwLightState off = snapshot(slots[typeIndex(chain.chain[0])]);
+
+    for (size_t i = 0; i < chain.length; i++) {
+        HwLightState state = i == 0 ? off : snapshot(slots[typeIndex(chain.chain[i])]);
+        if (isLit(state)) {
+            *type = chain.chain[i];
+            return state;
+        }
+    }
+
+    *type = chain.chain[0];
+    return off;
+}
+
+void Lights::recordResolved(size_t group, LightType type, const HwLightState& state) {
+    if (resolvedTypes[group] == type && resolvedStates[group] == state) {
+        return;
+    }
+
+    resolvedTypes[group] = type;
+    resolvedStates[group] = state;
+    transitions.record(typeIndex(type), state);
+}
+
+void Lights::applyLoop() {
+    struct pollfd fds[] = {
+        { wakeFd, POLLIN, 0 },
+    };
+    uint64_t count;
+
+    for (;;) {
+        if (TEMP_FAILURE_RETRY(poll(fds, 1, -1)) < 0) {
+            ALOGE("failed to poll: %s", strerror(errno));
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            TEMP_FAILURE_RETRY(read(wakeFd, &count, sizeof(count)));
+            if (stopping) {
+                return;
+            }
+            applyPending();
+        }
+    }
+}
+
+void Lights::applyPending() {
+    uint32_t pending = pendingGroups.exchange(0);
+
+    for (size_t group = 0; group < GROUP_COUNT; group++) {
+        if (!(pending & (1u << group)) || !groupPresent[group]) {
+            continue;
+        }
+
+        LightType type;
+        HwLightState state = resolve(group, &type);
+
+        {
+            std::lock_guard<std::mutex> nodeGuard(nodeLock);
+            recordResolved(group, type, state);
+        }
+
+        std::lock_guard<std::mutex> nodeGuard(nodeLock);
+        activeStats = &stats[typeIndex(type)];
+        (this->*handlers[group])(type, state);
+        activeStats = nullptr;
+    }
+}
+
+ndk::ScopedAStatus Lights::getLights(std::vector<HwLight>* _aidl_return) {
+    std::lock_guard<std::mutex> lock(lightsLock);
+
+    *_aidl_return = supportedLights;
+
+    return ndk::ScopedAStatus::ok();
+}
+
+binder_status_t Lights::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    dprintf(fd, "Light types:\n");
+    for (size_t index = 0; index < TYPE_COUNT; index++) {
+        const LightStats& typeStats = stats[index];
+
+        if (typeGroups[index] == GROUP_NONE) {
+            continue;
+        }
+
+        dprintf(fd, "  %-14s calls %" PRIu64 " writes %" PRIu64 " skipped %" PRIu64
+                " errors %" PRIu64 "\n", toString(static_cast<LightType>(index)).c_str(),
+                typeStats.calls.load(), typeStats.writes.load(), typeStats.skipped.load(),
+                typeStats.errors.load());
+        typeStats.latency.dump(fd);
+    }
+
+    dprintf(fd, "\nRecent transitions:\n");
+    transitions.dump(fd);
+
+    std::lock_guard<std::mutex> nodeGuard(nodeLock);
+
+    dprintf(fd, "\nResolved states:\n");
+    for (size_t group = 0; group < GROUP_COUNT; group++) {
+        if (groupPresent[group]) {
+            dprintf(fd, "  %-14s %s\n", toString(resolvedTypes[group]).c_str(),
+                    resolvedStates[group].toString().c_str());
+        }
+    }
+
+    dprintf(fd, "\n%-40s %12s %12s  %s\n", "node", "issued", "skipped", "value");
+    for (const LightNode& node : nodes) {
+        dprintf(fd, "%-40s %12" PRIu64 " %12" PRIu64 "  %s\n", node.file.path().c_str(),
+                node.writesIssued, node.writesSkipped, node.shadowValid ? node.shadow : "?");
+    }
+
+    return STATUS_OK;
+}
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/light/BnLights.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LedRegistry.h"
+#include "LightStats.h"
+#include "SysfsNode.h"
+
+using ::aidl::android::hardware::light::BnLights;
+using ::aidl::android::hardware::light::BrightnessMode;
+using ::aidl::android::hardware::light::FlashMode;
+using ::aidl::android::hardware::light::HwLight;
+using ::aidl::android::hardware::light::HwLightState;
+using ::aidl::android::hardware::light::LightType;
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace light {
+
+#define PATTERN_LEN     128
+
+/* The sysfs nodes the HAL writes, see nodeNames in Lights.cpp. */
+enum LightNodeId {
+    LCD_BRIGHTNESS,
+    WHITE_BRIGHTNESS,
+    WHITE_BREATH,
+    WHITE_DELAY_OFF,
+    WHITE_DELAY_ON,
+    WHITE_TRIGGER,
+    WHITE_PATTERN,
+    WHITE_REPEAT,
+    NODE_COUNT,
+};
+
+/* Light types sharing one LED, see groups in Lights.cpp. */
+enum LightGroupId {
+    GROUP_NOTIFICATION,
+    GROUP_BACKLIGHT,
+    GROUP_COUNT,
+    GROUP_NONE = GROUP_COUNT,
+};
+
+/* Light ids are the LightType values, one slot per type up to the last one we know. */
+static constexpr size_t TYPE_COUNT = static_cast<size_t>(LightType::WIFI) + 1;
+
+struct LightNode {
+    SysfsNode file;
+
+    /* Shadow of the last value the kernel accepted, valid only while shadowValid is set. */
+    char shadow[PATTERN_LEN];
+    bool shadowValid;
+
+    uint64_t writesIssued;
+    uint64_t writesSkipped;
+};
+
+/*
+ * The latest requested state of one light id. Binder threads publish it and
+ * the applier reads it under a sequence counter, so neither side ever blocks.
+ */
+struct LightSlot {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> color;
+    std::atomic<int32_t> flashMode;
+    std::atomic<int32_t> flashOnMs;
+    std::atomic<int32_t> flashOffMs;
+    std::atomic<int32_t> brightnessMode;
+};
+
+class Lights;
+
+typedef void (Lights::*LightStateHandler)(LightType, const HwLightState&);
+
+class Lights : public BnLights {
+  public:
+    /* root is the LED class directory, only tests point it anywhere but sysfs. */
+    explicit Lights(const std::string& root = "/sys/class/leds/");
+    ~Lights();
+
+    ndk::ScopedAStatus setLightState(int32_t id, const HwLightState& state) override;
+    ndk::ScopedAStatus getLights(std::vector<HwLight>* _aidl_return) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    void refresh();
+    uint32_t updateGroups();
+    void openNodes(uint32_t groupMask);
+    void updateSupportedLights();
+    void wake();
+
+    /* Node writes, called with nodeLock held. */
+    bool isStaleStr(LightNodeId id, const char* value) const;
+    bool isStale(LightNodeId id, int64_t value) const;
+    void invalidate(LightNodeId id);
+    bool setStr(LightNodeId id, const char* value);
+    bool set(LightNodeId id, int64_t value);
+
+    /* Group handlers, called with nodeLock held. */
+    void handleBacklight(LightType type, const HwLightState& state);
+    void handleNotification(LightType type, const HwLightState& state);
+    const char* getBatteryTrigger() const;
+    void setTrigger(const char* trigger);
+    void stopBreath();
+
+    static const LightStateHandler handlers[GROUP_COUNT];
+
+    HwLightState resolve(size_t group, LightType* type) const;
+    void recordResolved(size_t group, LightType type, const HwLightState& state);
+
+    /* Applier thread methods. */
+    void applyLoop();
+    void applyPending();
+
+    const std::string root;
+
+    /* Guards the sysfs nodes, held by the applier thread while it writes. */
+    std::mutex nodeLock;
+
+    std::mutex lightsLock;
+    std::vector<HwLight> supportedLights;
+
+    /* Bitmask of handler groups with a newly published state. */
+    std::atomic<uint32_t> pendingGroups{0};
+    std::atomic<bool> stopping{false};
+    std::thread applier;
+    int wakeFd;
+
+    LedRegistry registry;
+
+    /*
+     * Opened once by openNodes() and kept open for the lifetime of the service.
+     * The pattern trigger attributes only exist while that trigger is active, so
+     * they are opened on their first write.
+     */
+    LightNode nodes[NODE_COUNT] = {};
+
+    /* Capabilities of the LEDs driven by this HAL, refreshed from the registry on uevents. */
+    LedInfo lcdLed;
+    LedInfo whiteLed;
+
+    LightSlot slots[TYPE_COUNT] = {};
+    LightStats stats[TYPE_COUNT];
+
+    /* Statistics of the light type the applier is currently writing for. */
+    LightStats* activeStats = nullptr;
+
+    /* Set for the groups whose LED is actually present. */
+    std::atomic<bool> groupPresent[GROUP_COUNT] = {};
+
+    /* The state each group was last resolved to, guarded by the node lock. */
+    LightType resolvedTypes[GROUP_COUNT] = {};
+    HwLightState resolvedStates[GROUP_COUNT];
+    TransitionLog transitions;
+};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
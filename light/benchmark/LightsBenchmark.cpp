@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Drives Lights against a fake LED class tree on tmpfs and reports, per
+ * setLightState() call, the end-to-end latency until the value lands in the
+ * brightness node, the read/write syscalls of the whole process and the heap
+ * allocations.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Lights.h"
+
+using ::aidl::android::hardware::light::Lights;
+
+namespace {
+
+/* Where the fake tree goes, the first one we can write to wins. */
+static const char* const kTmpDirs[] = {
+    "/dev/shm",
+    "/dev",
+    "/data/local/tmp",
+};
+
+/* Calls per iteration of the notification storm, only the last one has to land. */
+static constexpr int kStormLength = 8;
+
+static std::atomic<uint64_t> allocations{0};
+
+/* Reads done by the benchmark itself, subtracted from the process totals. */
+static uint64_t ownReads;
+
+static int64_t nowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void writeFile(const std::string& path, const char* value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0 || write(fd, value, strlen(value)) < 0) {
+        fprintf(stderr, "failed to write %s: %s\n", path.c_str(), strerror(errno));
+        abort();
+    }
+    close(fd);
+}
+
+/* Syscalls of the read and write families issued by every thread of the process. */
+static uint64_t rwSyscalls() {
+    char buf[512];
+    uint64_t syscr = 0, syscw = 0;
+    int fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    ssize_t len = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (len <= 0) {
+        return 0;
+    }
+
+    ownReads++;
+    buf[len] = '\0';
+
+    for (char* line = strtok(buf, "\n"); line; line = strtok(nullptr, "\n")) {
+        sscanf(line, "syscr: %" SCNu64, &syscr);
+        sscanf(line, "syscw: %" SCNu64, &syscw);
+    }
+
+    return syscr + syscw;
+}
+
+/* Lights on a copy of /sys/class/leds/{lcd-backlight,red}, kept for the whole run. */
+class FakeLeds {
+  public:
+    static FakeLeds& get() {
+        static FakeLeds sLeds;
+        return sLeds;
+    }
+
+    Lights& lights() { return *mLights; }
+
+    /* Spin until the LED's brightness node holds the three digit value. */
+    void waitFor(const char* led, uint32_t value) {
+        int fd = strcmp(led, "red") ? mLcdFd : mRedFd;
+        char want[4], buf[4];
+
+        snprintf(want, sizeof(want), "%03u", value);
+        do {
+            ownReads++;
+        } while (pread(fd, buf, 3, 0) != 3 || memcmp(buf, want, 3));
+    }
+
+  private:
+    FakeLeds() {
+        for (const char* dir : kTmpDirs) {
+            std::string path = std::string(dir) + "/lights-benchmark-XXXXXX";
+            if (mkdtemp(&path[0])) {
+                mRoot = path + "/";
+                break;
+            }
+        }
+        if (mRoot.empty()) {
+            fprintf(stderr, "no writable tmpfs for the fake LED tree\n");
+            abort();
+        }
+
+        makeLed("lcd-backlight", {});
+        makeLed("red", {"breath", "delay_off", "delay_on"});
+        writeFile(mRoot + "red/trigger", "[none] timer");
+        mPaths.push_back(mRoot + "red/trigger");
+
+        mLcdFd = open((mRoot + "lcd-backlight/brightness").c_str(), O_RDONLY | O_CLOEXEC);
+        mRedFd = open((mRoot + "red/brightness").c_str(), O_RDONLY | O_CLOEXEC);
+
+        mLights = ndk::SharedRefBase::make<Lights>(mRoot);
+    }
+
+    ~FakeLeds() {
+        /* Joins the applier before the tree it writes to goes away. */
+        mLights.reset();
+
+        close(mLcdFd);
+        close(mRedFd);
+
+        for (auto it = mPaths.rbegin(); it != mPaths.rend(); ++it) {
+            remove(it->c_str());
+        }
+        rmdir(mRoot.c_str());
+    }
+
+    void makeLed(const char* name, std::vector<const char*> nodes) {
+        std::string dir = mRoot + name + "/";
+
+        mkdir(dir.c_str(), 0755);
+        mPaths.push_back(dir);
+
+        nodes.push_back("brightness");
+        nodes.push_back("max_brightness");
+        for (const char* node : nodes) {
+            writeFile(dir + node, strcmp(node, "max_brightness") ? "000" : "255");
+            mPaths.push_back(dir + node);
+        }
+    }
+
+    std::string mRoot;
+    int mLcdFd{-1};
+    int mRedFd{-1};
+    /* Everything created under mRoot, removed in reverse order on exit. */
+    std::vector<std::string> mPaths;
+    std::shared_ptr<Lights> mLights;
+};
+
+/* A steady white light of the given 0-255 level. */
+static HwLightState solid(uint32_t level) {
+    HwLightState state = {};
+
+    state.color = static_cast<int32_t>(0xff000000 | (level << 16) | (level << 8) | level);
+    state.flashMode = FlashMode::NONE;
+    state.brightnessMode = BrightnessMode::USER;
+
+    return state;
+}
+
+static int32_t lightId(LightType type) {
+    return static_cast<int32_t>(type);
+}
+
+/* Per-call counters over one run of a benchmark loop. */
+class CallStats {
+  public:
+    explicit CallStats(benchmark::State& state) : mState(state) {
+        mLatencies.reserve(state.max_iterations);
+        mOwnReads = ownReads;
+        mSyscalls = rwSyscalls();
+        mAllocations = allocations.load();
+    }
+
+    void record(int64_t latencyNs, int calls) {
+        mLatencies.push_back(latencyNs);
+        mCalls += calls;
+    }
+
+    void report() {
+        uint64_t allocs = allocations.load() - mAllocations;
+        uint64_t syscalls = rwSyscalls() - mSyscalls - (ownReads - mOwnReads);
+
+        if (mLatencies.empty()) {
+            return;
+        }
+
+        std::sort(mLatencies.begin(), mLatencies.end());
+        mState.counters["p50_us"] = mLatencies[mLatencies.size() / 2] / 1000.0;
+        mState.counters["p99_us"] = mLatencies[mLatencies.size() * 99 / 100] / 1000.0;
+        mState.counters["syscalls_per_call"] = static_cast<double>(syscalls) / mCalls;
+        mState.counters["allocs_per_call"] = static_cast<double>(allocs) / mCalls;
+    }
+
+  private:
+    benchmark::State& mState;
+    std::vector<int64_t> mLatencies;
+    uint64_t mCalls{0};
+    uint64_t mOwnReads;
+    uint64_t mSyscalls;
+    uint64_t mAllocations;
+};
+
+/* The backlight moved back and forth between two levels, one call per step. */
+static void BM_BacklightSweep(benchmark::State& state) {
+    FakeLeds& leds = FakeLeds::get();
+    uint32_t level = 100;
+    CallStats stats(state);
+
+    for (auto _ : state) {
+        level = level == 100 ? 200 : 100;
+
+        int64_t startNs = nowNs();
+        leds.lights().setLightState(lightId(LightType::BACKLIGHT), solid(level));
+        leds.waitFor("lcd-backlight", level);
+        stats.record(nowNs() - startNs, 1);
+    }
+
+    stats.report();
+}
+BENCHMARK(BM_BacklightSweep);
+
+/* Bursts of notification updates, of which the applier only has to write the last. */
+static void BM_NotificationStorm(benchmark::State& state) {
+    FakeLeds& leds = FakeLeds::get();
+    uint32_t level = 100;
+    CallStats stats(state);
+
+    for (auto _ : state) {
+        level = level == 100 ? 200 : 100;
+
+        int64_t startNs = nowNs();
+        for (int i = kStormLength - 1; i >= 0; i--) {
+            leds.lights().setLightState(lightId(LightType::NOTIFICATIONS), solid(level + i));
+        }
+        leds.waitFor("red", level);
+        stats.record(nowNs() - startNs, kStormLength);
+    }
+
+    stats.report();
+}
+BENCHMARK(BM_NotificationStorm);
+
+/* Notifications coming and going over a lit battery light on the same LED. */
+static void BM_MixedPriorities(benchmark::State& state) {
+    FakeLeds& leds = FakeLeds::get();
+    bool notify = false;
+
+    leds.lights().setLightState(lightId(LightType::NOTIFICATIONS), solid(0));
+    leds.lights().setLightState(lightId(LightType::BATTERY), solid(100));
+    leds.waitFor("red", 100);
+
+    CallStats stats(state);
+
+    for (auto _ : state) {
+        notify = !notify;
+
+        int64_t startNs = nowNs();
+        leds.lights().setLightState(lightId(LightType::NOTIFICATIONS), solid(notify ? 200 : 0));
+        leds.waitFor("red", notify ? 200 : 100);
+        stats.record(nowNs() - startNs, 1);
+    }
+
+    stats.report();
+
+    leds.lights().setLightState(lightId(LightType::BATTERY), solid(0));
+}
+BENCHMARK(BM_MixedPriorities);
+
+}  // anonymous namespace
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t /* size */) noexcept {
+    free(ptr);
+}
+
+BENCHMARK_MAIN();
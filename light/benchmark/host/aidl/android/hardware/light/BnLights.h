@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the generated android.hardware.light NDK stub. It keeps
+ * the ILights method signatures so Lights builds unchanged against it.
+ */
+
+#pragma once
+
+#include <android/binder_interface_utils.h>
+#include <aidl/android/hardware/light/HwLightState.h>
+
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace light {
+
+class ILights : public ndk::ICInterface {
+  public:
+    virtual ndk::ScopedAStatus setLightState(int32_t id, const HwLightState& state) = 0;
+    virtual ndk::ScopedAStatus getLights(std::vector<HwLight>* _aidl_return) = 0;
+};
+
+class BnLights : public ILights {};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
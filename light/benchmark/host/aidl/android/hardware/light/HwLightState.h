@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host stand-in for the generated android.hardware.light parcelables, see BnLights.h. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace light {
+
+enum class FlashMode : int8_t {
+    NONE = 0,
+    TIMED = 1,
+    HARDWARE = 2,
+};
+
+enum class BrightnessMode : int8_t {
+    USER = 0,
+    SENSOR = 1,
+    LOW_PERSISTENCE = 2,
+};
+
+enum class LightType : int8_t {
+    BACKLIGHT = 0,
+    KEYBOARD = 1,
+    BUTTONS = 2,
+    BATTERY = 3,
+    NOTIFICATIONS = 4,
+    ATTENTION = 5,
+    BLUETOOTH = 6,
+    WIFI = 7,
+};
+
+static inline std::string toString(LightType type) {
+    return std::to_string(static_cast<int>(type));
+}
+
+struct HwLightState {
+    int32_t color = 0;
+    FlashMode flashMode = FlashMode::NONE;
+    int32_t flashOnMs = 0;
+    int32_t flashOffMs = 0;
+    BrightnessMode brightnessMode = BrightnessMode::USER;
+
+    bool operator==(const HwLightState& other) const {
+        return color == other.color && flashMode == other.flashMode &&
+               flashOnMs == other.flashOnMs && flashOffMs == other.flashOffMs &&
+               brightnessMode == other.brightnessMode;
+    }
+    bool operator!=(const HwLightState& other) const { return !(*this == other); }
+
+    std::string toString() const {
+        return "HwLightState{color: " + std::to_string(color) +
+               ", flashMode: " + std::to_string(static_cast<int>(flashMode)) +
+               ", flashOnMs: " + std::to_string(flashOnMs) +
+               ", flashOffMs: " + std::to_string(flashOffMs) +
+               ", brightnessMode: " + std::to_string(static_cast<int>(brightnessMode)) + "}";
+    }
+};
+
+struct HwLight {
+    int32_t id = 0;
+    int32_t ordinal = 0;
+    LightType type = LightType::BACKLIGHT;
+};
+
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
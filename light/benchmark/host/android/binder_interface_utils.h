@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the part of libbinder_ndk the light HAL uses, so the
+ * benchmark can drive Lights without a binder driver. Nothing is ever
+ * transacted, the statuses only carry their code.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <utility>
+
+typedef int32_t binder_status_t;
+typedef int32_t binder_exception_t;
+
+enum {
+    STATUS_OK = 0,
+};
+
+enum {
+    EX_NONE = 0,
+    EX_UNSUPPORTED_OPERATION = -7,
+};
+
+namespace ndk {
+
+class ScopedAStatus {
+  public:
+    static ScopedAStatus ok() { return ScopedAStatus(EX_NONE); }
+    static ScopedAStatus fromExceptionCode(binder_exception_t exception) {
+        return ScopedAStatus(exception);
+    }
+
+    bool isOk() const { return mException == EX_NONE; }
+    binder_exception_t getExceptionCode() const { return mException; }
+
+  private:
+    explicit ScopedAStatus(binder_exception_t exception) : mException(exception) {}
+
+    binder_exception_t mException;
+};
+
+class SharedRefBase : public std::enable_shared_from_this<SharedRefBase> {
+  public:
+    virtual ~SharedRefBase() {}
+
+    template <class T, class... Args>
+    static std::shared_ptr<T> make(Args&&... args) {
+        return std::shared_ptr<T>(new T(std::forward<Args>(args)...));
+    }
+};
+
+class ICInterface : public SharedRefBase {
+  public:
+    virtual binder_status_t dump(int /* fd */, const char** /* args */, uint32_t /* numArgs */) {
+        return STATUS_OK;
+    }
+};
+
+}  // namespace ndk
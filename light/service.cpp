@@ -14,37 +14,32 @@
  * limitations under the License.
  */
 
-#define LOG_TAG "android.hardware.light@2.0-service.onclite"
+#define LOG_TAG "android.hardware.light-service.onclite"
 
-#include <hidl/HidlTransportSupport.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <log/log.h>
 
-#include "Light.h"
+#include "Lights.h"
 
-using android::hardware::configureRpcThreadpool;
-using android::hardware::joinRpcThreadpool;
-
-using android::hardware::light::V2_0::ILight;
-using android::hardware::light::V2_0::implementation::Light;
-
-using android::OK;
-using android::sp;
-using android::status_t;
+using ::aidl::android::hardware::light::Lights;
 
 int main() {
-    sp<ILight> service = new Light();
+    ABinderProcess_setThreadPoolMaxThreadCount(0);
 
-    configureRpcThreadpool(1, true);
+    std::shared_ptr<Lights> lights = ndk::SharedRefBase::make<Lights>();
 
-    status_t status = service->registerAsService();
-    if (status != OK) {
-        ALOGE("Cannot register Light HAL service.");
+    const std::string instance = std::string() + Lights::descriptor + "/default";
+    binder_status_t status = AServiceManager_addService(lights->asBinder().get(), instance.c_str());
+    if (status != STATUS_OK) {
+        ALOGE("Cannot register Lights HAL service.");
         return 1;
     }
 
-    ALOGI("Light HAL service ready.");
+    ALOGI("Lights HAL service ready.");
 
-    joinRpcThreadpool();
+    ABinderProcess_joinThreadPool();
 
-    ALOGI("Light HAL service failed to join thread pool.");
+    ALOGI("Lights HAL service failed to join thread pool.");
     return 1;
 }
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Tunable.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <utils/Trace.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/* First CPU of the little and big policy, the order of BoostLevel::clusters. */
+static const unsigned kBoostClusterCpu[] = {0, 4};
+
+/* Floors raised by a boost, 0 leaves the node alone. */
+struct BoostLevel {
+    struct {
+        int64_t minFreqKhz;
+        int64_t hispeedFreqKhz;
+    } clusters[2];
+    int64_t cpubwMbps;
+};
+
+/*
+ * SDM632 idles its little policy at 614400 kHz with a 1363200 kHz hispeed
+ * and its big one at 633600 kHz with 1401600 kHz, both topping out at
+ * 1804800 kHz, over a 1611 MBps cpubw floor.
+ */
+static const BoostLevel kBoostLevels[] = {
+        /* INTERACTION */
+        {{{1036800, 1536000}, {1094400, 1555200}}, 3221},
+        /* LAUNCH */
+        {{{1670400, 1804800}, {1555200, 1804800}}, 5859},
+};
+
+/*
+ * Timed, refcounted boosts. Every boost holds one reference on its kind and
+ * drops it when its timer expires, so overlapping boosts keep the floors up
+ * until the last one ends. Timers sit on a single wheel that a timerfd
+ * advances while any are pending; the same thread serves watched input fds.
+ */
+class BoostEngine {
+  public:
+    enum Kind : uint8_t {
+        INTERACTION,
+        LAUNCH,
+        KINDS,
+    };
+
+    static BoostEngine& get() {
+        static BoostEngine sEngine;
+        return sEngine;
+    }
+
+    bool boost(Kind kind, int32_t durationMs) {
+        ATRACE_NAME("BoostEngine::boost");
+        if (durationMs <= 0) {
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        /* A running wheel is partway through a tick, so wait one more to never end early. */
+        uint32_t ticks = (durationMs + kTickMs - 1) / kTickMs + (mPending ? 1 : 0);
+        uint32_t rounds = (ticks - 1) / kSlots;
+        mWheel[(mCursor + ticks) % kSlots].push_back({kind, rounds});
+        if (mPending++ == 0) {
+            arm(true);
+        }
+        return hold(kind);
+    }
+
+    /* Drops every pending boost of a kind. */
+    bool cancel(Kind kind) {
+        std::lock_guard<std::mutex> lock(mLock);
+        bool ok = true;
+        for (auto& slot : mWheel) {
+            for (auto it = slot.begin(); it != slot.end();) {
+                if (it->kind != kind) {
+                    ++it;
+                    continue;
+                }
+                it = slot.erase(it);
+                mPending--;
+                ok &= drop(kind);
+            }
+        }
+        if (mPending == 0) {
+            arm(false);
+        }
+        return ok;
+    }
+
+    /* Whether a boost of kind currently holds its floors. */
+    bool isActive(Kind kind) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mRefs[kind] > 0;
+    }
+
+    /* Runs handler on the boost thread whenever fd has one of events pending. */
+    bool watch(int fd, uint32_t events, std::function<void(uint32_t)> handler) {
+        {
+            std::lock_guard<std::mutex> lock(mWatchLock);
+            mWatches[fd] = std::move(handler);
+        }
+        struct epoll_event event = {.events = events, .data = {.fd = fd}};
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ALOGE("Failed to watch fd %d: %s", fd, strerror(errno));
+            unwatch(fd);
+            return false;
+        }
+        return true;
+    }
+
+    void unwatch(int fd) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+        std::lock_guard<std::mutex> lock(mWatchLock);
+        mWatches.erase(fd);
+    }
+
+  private:
+    static constexpr size_t kClusters = sizeof(kBoostClusterCpu) / sizeof(kBoostClusterCpu[0]);
+    static constexpr int32_t kTickMs = 10;
+    static constexpr size_t kSlots = 128;
+    /* Tunable layer owners, clear of the powerhint.xml hint ids. */
+    static constexpr uint32_t kOwnerBase = 0x10000;
+
+    struct Timer {
+        Kind kind;
+        /* Full turns of the wheel left before the timer fires. */
+        uint32_t rounds;
+    };
+
+    BoostEngine() {
+        for (size_t i = 0; i < kClusters; i++) {
+            char path[PATH_MAX];
+            unsigned cpu = kBoostClusterCpu[i];
+
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_min_freq",
+                     cpu);
+            mMinFreq[i] = Tunables::get().node(path, TunableNode::MAX);
+            snprintf(path, sizeof(path),
+                     "/sys/devices/system/cpu/cpu%u/cpufreq/schedutil/hispeed_freq", cpu);
+            mHispeedFreq[i] = Tunables::get().node(path, TunableNode::MAX);
+        }
+        mCpubw = Tunables::get().node("/sys/class/devfreq/soc:qcom,cpubw/min_freq",
+                                      TunableNode::MAX);
+
+        mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (mTimerFd < 0 || mEpollFd < 0) {
+            ALOGE("Failed to create boost timer: %s", strerror(errno));
+            return;
+        }
+
+        struct epoll_event event = {.events = EPOLLIN, .data = {.fd = mTimerFd}};
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTimerFd, &event);
+        std::thread(&BoostEngine::loop, this).detach();
+    }
+
+    void arm(bool enabled) {
+        struct itimerspec spec = {};
+        if (enabled) {
+            spec.it_interval.tv_nsec = kTickMs * 1000000L;
+            spec.it_value = spec.it_interval;
+        }
+        timerfd_settime(mTimerFd, 0, &spec, nullptr);
+    }
+
+    bool hold(Kind kind) {
+        if (mRefs[kind]++ > 0) {
+            return true;
+        }
+
+        const BoostLevel& level = kBoostLevels[kind];
+        std::lock_guard<std::mutex> lock(Tunables::get().lock());
+        bool ok = true;
+        for (size_t i = 0; i < kClusters; i++) {
+            ok &= push(mMinFreq[i], kind, level.clusters[i].minFreqKhz);
+            ok &= push(mHispeedFreq[i], kind, level.clusters[i].hispeedFreqKhz);
+        }
+        ok &= push(mCpubw, kind, level.cpubwMbps);
+        return ok;
+    }
+
+    bool drop(Kind kind) {
+        if (mRefs[kind] == 0 || --mRefs[kind] > 0) {
+            return true;
+        }
+
+        const BoostLevel& level = kBoostLevels[kind];
+        std::lock_guard<std::mutex> lock(Tunables::get().lock());
+        bool ok = true;
+        ok &= pop(mCpubw, kind, level.cpubwMbps);
+        for (size_t i = kClusters; i-- > 0;) {
+            ok &= pop(mHispeedFreq[i], kind, level.clusters[i].hispeedFreqKhz);
+            ok &= pop(mMinFreq[i], kind, level.clusters[i].minFreqKhz);
+        }
+        return ok;
+    }
+
+    static bool push(TunableNode* node, Kind kind, int64_t value) {
+        return !node || !value || node->push(kOwnerBase + kind, value);
+    }
+
+    static bool pop(TunableNode* node, Kind kind, int64_t value) {
+        return !node || !value || node->pop(kOwnerBase + kind);
+    }
+
+    void expire(uint64_t ticks) {
+        std::lock_guard<std::mutex> lock(mLock);
+        while (ticks-- > 0 && mPending > 0) {
+            mCursor = (mCursor + 1) % kSlots;
+            auto& slot = mWheel[mCursor];
+            for (auto it = slot.begin(); it != slot.end();) {
+                if (it->rounds > 0) {
+                    it->rounds--;
+                    ++it;
+                    continue;
+                }
+                Kind kind = it->kind;
+                it = slot.erase(it);
+                mPending--;
+                drop(kind);
+            }
+        }
+        if (mPending == 0) {
+            arm(false);
+        }
+    }
+
+    void loop() {
+        struct epoll_event events[8];
+        while (true) {
+            int count = epoll_wait(mEpollFd, events, 8, -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ALOGE("Boost loop failed: %s", strerror(errno));
+                return;
+            }
+
+            for (int i = 0; i < count; i++) {
+                int fd = events[i].data.fd;
+                if (fd == mTimerFd) {
+                    uint64_t ticks;
+                    if (read(mTimerFd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+                        expire(ticks);
+                    }
+                    continue;
+                }
+
+                std::function<void(uint32_t)> handler;
+                {
+                    std::lock_guard<std::mutex> lock(mWatchLock);
+                    auto it = mWatches.find(fd);
+                    if (it != mWatches.end()) {
+                        handler = it->second;
+                    }
+                }
+                if (handler) {
+                    handler(events[i].events);
+                }
+            }
+        }
+    }
+
+    std::mutex mLock;
+    std::vector<Timer> mWheel[kSlots];
+    size_t mCursor{0};
+    size_t mPending{0};
+    uint32_t mRefs[KINDS]{};
+
+    TunableNode* mMinFreq[kClusters]{};
+    TunableNode* mHispeedFreq[kClusters]{};
+    TunableNode* mCpubw{nullptr};
+
+    std::mutex mWatchLock;
+    std::map<int, std::function<void(uint32_t)>> mWatches;
+
+    int mTimerFd{-1};
+    int mEpollFd{-1};
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
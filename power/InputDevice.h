@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "BoostEngine.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <linux/input.h>
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+static constexpr const char* kInputDir = "/dev/input";
+
+static constexpr int kInputEventWakeupModeOff = 4;
+static constexpr int kInputEventWakeupModeOn = 5;
+
+/* Overrides the touch controller names below, for panels not listed. */
+static constexpr const char* kTouchDeviceProp = "ro.vendor.power.touch_device";
+
+/* Touch controllers fitted to onclite, as reported by EVIOCGNAME. */
+static const char* const kTouchDeviceNames[] = {
+        "fts_ts",
+        "NVTCapacitiveTouchScreen",
+        "ilitek_ts",
+};
+
+static std::string inputDeviceName(int fd) {
+    char name[80] = {};
+    if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) < 0) {
+        return std::string();
+    }
+    return name;
+}
+
+static bool isTouchDeviceName(const std::string& name, const std::string& wanted) {
+    if (!wanted.empty()) {
+        return name == wanted;
+    }
+
+    char prop[PROPERTY_VALUE_MAX];
+    if (property_get(kTouchDeviceProp, prop, "") > 0) {
+        return name == prop;
+    }
+    for (const char* known : kTouchDeviceNames) {
+        if (name == known) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Opens the touchscreen's evdev node with flags, searching by name so that
+ * probe order does not matter. An empty name stands for the touch controllers
+ * above. Returns -1 when no touchscreen is present.
+ */
+static int openTouchDevice(const std::string& name, int flags, std::string* path) {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(kInputDir), closedir);
+    if (!dir) {
+        return -1;
+    }
+
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (strncmp(entry->d_name, "event", 5)) {
+            continue;
+        }
+
+        std::string candidate = std::string(kInputDir) + "/" + entry->d_name;
+        int fd = open(candidate.c_str(), flags | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (isTouchDeviceName(inputDeviceName(fd), name)) {
+            if (path) {
+                *path = candidate;
+            }
+            return fd;
+        }
+        close(fd);
+    }
+
+    return -1;
+}
+
+/*
+ * The touchscreen's event node, found once and kept open. /dev/input is
+ * watched with inotify so that the node is found again, and the last double
+ * tap to wake setting replayed, whenever the controller is re-probed.
+ * Events are drained on the boost engine's thread while a handler is set.
+ */
+class TouchDevice {
+  public:
+    using Handler = std::function<void(const struct input_event*, size_t)>;
+
+    static TouchDevice& get() {
+        static TouchDevice sDevice;
+        return sDevice;
+    }
+
+    /*
+     * Tracks the input device called name instead of the touchscreen, for
+     * tests. The boost engine keeps calling into it, so it must never go away.
+     */
+    explicit TouchDevice(std::string name) : mName(std::move(name)) { init(); }
+
+    bool setWakeupMode(bool enabled) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mWakeup = enabled;
+        mWakeupSet = true;
+        if (mFd < 0) {
+            reopenLocked();
+        }
+        if (mFd < 0) {
+            ALOGE("No touchscreen to set the wakeup mode on");
+            return false;
+        }
+        return writeWakeupLocked();
+    }
+
+    /*
+     * Receives every batch of events read from the touchscreen. The node is
+     * only polled while a handler is set, so an empty one stops the wakeups.
+     */
+    void setHandler(Handler handler) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mHandler = std::move(handler);
+        updateWatchLocked();
+    }
+
+  private:
+    TouchDevice() { init(); }
+
+    void init() {
+        mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (mInotifyFd < 0 ||
+            inotify_add_watch(mInotifyFd, kInputDir, IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+            ALOGE("Failed to watch %s: %s", kInputDir, strerror(errno));
+        } else {
+            BoostEngine::get().watch(mInotifyFd, EPOLLIN,
+                                     [this](uint32_t /* events */) { onInputDirChanged(); });
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        reopenLocked();
+    }
+
+    void reopenLocked() {
+        mFd = openTouchDevice(mName, O_RDWR | O_NONBLOCK, &mPath);
+        if (mFd < 0) {
+            return;
+        }
+        ALOGI("Touchscreen at %s", mPath.c_str());
+
+        updateWatchLocked();
+        if (mWakeupSet) {
+            writeWakeupLocked();
+        }
+    }
+
+    void closeLocked() {
+        if (mFd < 0) {
+            return;
+        }
+        if (mWatched) {
+            BoostEngine::get().unwatch(mFd);
+            mWatched = false;
+        }
+        close(mFd);
+        mFd = -1;
+        mPath.clear();
+    }
+
+    void updateWatchLocked() {
+        bool wanted = mFd >= 0 && mHandler;
+        if (wanted == mWatched) {
+            return;
+        }
+        if (wanted) {
+            mWatched = BoostEngine::get().watch(mFd, EPOLLIN,
+                                                [this](uint32_t events) { onInput(events); });
+        } else {
+            BoostEngine::get().unwatch(mFd);
+            mWatched = false;
+        }
+    }
+
+    bool writeWakeupLocked() {
+        struct input_event ev = {};
+        ev.type = EV_SYN;
+        ev.code = SYN_CONFIG;
+        ev.value = mWakeup ? kInputEventWakeupModeOn : kInputEventWakeupModeOff;
+        if (write(mFd, &ev, sizeof(ev)) != sizeof(ev)) {
+            ALOGE("Failed to set the wakeup mode on %s: %s", mPath.c_str(), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    /* Only runs on the boost engine's thread, which is also the only one closing mFd. */
+    void onInput(uint32_t events) {
+        Handler handler;
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            handler = mHandler;
+            fd = mFd;
+        }
+        if (fd < 0) {
+            return;
+        }
+
+        struct input_event ev[32];
+        ssize_t len;
+        while ((len = read(fd, ev, sizeof(ev))) > 0) {
+            if (handler) {
+                handler(ev, len / sizeof(ev[0]));
+            }
+        }
+
+        if ((len < 0 && errno == ENODEV) || (events & (EPOLLHUP | EPOLLERR))) {
+            std::lock_guard<std::mutex> lock(mLock);
+            ALOGW("Touchscreen at %s went away", mPath.c_str());
+            closeLocked();
+        }
+    }
+
+    void onInputDirChanged() {
+        alignas(struct inotify_event) char buf[4096];
+        bool rescan = false;
+        ssize_t len;
+
+        std::lock_guard<std::mutex> lock(mLock);
+        while ((len = read(mInotifyFd, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + len;) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                p += sizeof(*event) + event->len;
+                if (!event->len || strncmp(event->name, "event", 5)) {
+                    continue;
+                }
+
+                std::string path = std::string(kInputDir) + "/" + event->name;
+                if ((event->mask & IN_DELETE) && path == mPath) {
+                    closeLocked();
+                }
+                /* ueventd fixes up the permissions after the node shows up. */
+                if (event->mask & (IN_CREATE | IN_ATTRIB)) {
+                    rescan = true;
+                }
+            }
+        }
+
+        if (rescan && mFd < 0) {
+            reopenLocked();
+        }
+    }
+
+    const std::string mName;
+
+    std::mutex mLock;
+    int mFd{-1};
+    bool mWatched{false};
+    std::string mPath;
+    int mInotifyFd{-1};
+    bool mWakeup{false};
+    bool mWakeupSet{false};
+    Handler mHandler;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
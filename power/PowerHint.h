@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Tunable.h"
+
+#include <libxml/parser.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/* Hint ids used by powerhint.xml, as the perf HAL knows them. */
+enum PowerHintId : uint32_t {
+    POWER_HINT_VIDEO_ENCODE = 0x1203,
+    POWER_HINT_VIDEO_DECODE = 0x1204,
+    POWER_HINT_SUSTAINED_PERFORMANCE = 0x1206,
+    POWER_HINT_VR = 0x1207,
+    POWER_HINT_CAMERA_PREVIEW = 0x1300,
+    POWER_HINT_VR_SUSTAINED_PERFORMANCE = 0x1301,
+};
+
+/*
+ * Resource opcodes are 0x40000000 plus a major type in bits 22-28, a minor
+ * type in bits 14-21 and a cluster in bits 8-11. Only the resources this
+ * device's powerhint.xml uses are decoded; the interactive governor minors
+ * other than hispeed load and frequency have no schedutil counterpart and
+ * are dropped. A resource may be listed more than once, the first path that
+ * exists on this kernel is used.
+ */
+struct ResourceMap {
+    uint8_t major;
+    uint8_t minor;
+    /* %u is replaced by the first CPU of the cluster. */
+    const char* path;
+    TunableNode::Combine combine;
+    /* Multiplier from the powerhint.xml unit to the sysfs unit. */
+    int64_t scale;
+};
+
+static const ResourceMap kResourceMap[] = {
+        {0x2, 0x0, "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_min_freq", TunableNode::MAX,
+         1000},
+        {0x2, 0x1, "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_max_freq", TunableNode::MIN,
+         1000},
+        /* SDM632 runs one schedutil instance per policy, msm8953 a global one. */
+        {0x5, 0x4, "/sys/devices/system/cpu/cpu%u/cpufreq/schedutil/hispeed_load",
+         TunableNode::LATEST, 1},
+        {0x5, 0x4, "/sys/devices/system/cpu/cpufreq/schedutil/hispeed_load", TunableNode::LATEST,
+         1},
+        {0x5, 0x5, "/sys/devices/system/cpu/cpu%u/cpufreq/schedutil/hispeed_freq",
+         TunableNode::MAX, 1000},
+        {0x5, 0x5, "/sys/devices/system/cpu/cpufreq/schedutil/hispeed_freq", TunableNode::MAX,
+         1000},
+        {0x6, 0x3, "/sys/class/devfreq/soc:qcom,cpubw/bw_hwmon/hyst_length", TunableNode::LATEST,
+         1},
+        {0x6, 0x4, "/sys/class/devfreq/soc:qcom,cpubw/bw_hwmon/low_power_ceil_mbps",
+         TunableNode::LATEST, 1},
+        {0x6, 0x5, "/sys/class/devfreq/soc:qcom,cpubw/bw_hwmon/low_power_io_percent",
+         TunableNode::LATEST, 1},
+        {0x6, 0x8, "/sys/class/devfreq/soc:qcom,cpubw/bw_hwmon/sample_ms", TunableNode::LATEST,
+         1},
+        {0xA, 0x3, "/sys/class/kgsl/kgsl-3d0/devfreq/min_freq", TunableNode::MAX, 1000000},
+        {0xA, 0x4, "/sys/class/kgsl/kgsl-3d0/devfreq/max_freq", TunableNode::MIN, 1000000},
+        {0xA, 0x5, "/sys/class/devfreq/soc:qcom,gpubw/min_freq", TunableNode::MAX, 1},
+};
+
+/* First CPU of the perf HAL's cluster 0 (big) and 1 (little). */
+static const unsigned kClusterCpu[] = {4, 0};
+
+/*
+ * powerhint.xml compiled into per-hint lists of cached-fd writes. Applying
+ * a hint pushes one layer per write and releasing it pops them in reverse,
+ * with nested applies of the same hint refcounted.
+ */
+class PowerHints {
+  public:
+    explicit PowerHints(const char* path) { load(path); }
+
+    bool has(uint32_t id) const { return mHints.count(id) != 0; }
+
+    bool apply(uint32_t id) {
+        ATRACE_NAME("PowerHints::apply");
+        auto it = mHints.find(id);
+        if (it == mHints.end()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(Tunables::get().lock());
+        Hint& hint = it->second;
+        if (hint.refs++ > 0) {
+            return true;
+        }
+
+        bool ok = true;
+        for (const auto& action : hint.actions) {
+            ok &= action.node->push(id, action.value);
+        }
+        return ok;
+    }
+
+    bool release(uint32_t id) {
+        ATRACE_NAME("PowerHints::release");
+        auto it = mHints.find(id);
+        if (it == mHints.end()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(Tunables::get().lock());
+        Hint& hint = it->second;
+        if (hint.refs == 0) {
+            return false;
+        }
+        if (--hint.refs > 0) {
+            return true;
+        }
+
+        bool ok = true;
+        for (auto action = hint.actions.rbegin(); action != hint.actions.rend(); ++action) {
+            ok &= action->node->pop(id);
+        }
+        return ok;
+    }
+
+  private:
+    struct Action {
+        TunableNode* node;
+        int64_t value;
+    };
+
+    struct Hint {
+        std::vector<Action> actions;
+        uint32_t refs{0};
+    };
+
+    static std::string property(xmlNodePtr node, const char* name) {
+        xmlChar* value = xmlGetProp(node, reinterpret_cast<const xmlChar*>(name));
+        if (!value) {
+            return std::string();
+        }
+        std::string result(reinterpret_cast<const char*>(value));
+        xmlFree(value);
+        return result;
+    }
+
+    void load(const char* path) {
+        xmlDocPtr doc = xmlReadFile(path, nullptr, XML_PARSE_NOBLANKS);
+        if (!doc) {
+            ALOGE("Failed to parse %s", path);
+            return;
+        }
+
+        xmlNodePtr root = xmlDocGetRootElement(doc);
+        for (xmlNodePtr group = root ? root->children : nullptr; group; group = group->next) {
+            if (xmlStrcmp(group->name, BAD_CAST "Powerhint")) {
+                continue;
+            }
+            for (xmlNodePtr config = group->children; config; config = config->next) {
+                if (!xmlStrcmp(config->name, BAD_CAST "Config")) {
+                    parseConfig(config);
+                }
+            }
+        }
+
+        xmlFreeDoc(doc);
+    }
+
+    void parseConfig(xmlNodePtr config) {
+        if (property(config, "Enable") != "true") {
+            return;
+        }
+
+        uint32_t id = strtoul(property(config, "Id").c_str(), nullptr, 16);
+        std::string resources = property(config, "Resources");
+
+        std::vector<int64_t> values;
+        const char* p = resources.c_str();
+        while (*p) {
+            char* end;
+            long long value = strtoll(p, &end, 16);
+            if (end == p) {
+                p++;
+                continue;
+            }
+            values.push_back(value);
+            p = end;
+        }
+        if (values.size() % 2) {
+            ALOGE("Hint 0x%x has an odd number of resource values", id);
+            return;
+        }
+
+        Hint& hint = mHints[id];
+        for (size_t i = 0; i < values.size(); i += 2) {
+            addAction(id, &hint, values[i], values[i + 1]);
+        }
+    }
+
+    static void addAction(uint32_t id, Hint* hint, uint32_t opcode, int64_t value) {
+        uint32_t resource = opcode - 0x40000000;
+        uint8_t major = (resource >> 22) & 0x7F;
+        uint8_t minor = (resource >> 14) & 0xFF;
+        uint8_t cluster = (resource >> 8) & 0xF;
+
+        if (cluster >= sizeof(kClusterCpu) / sizeof(kClusterCpu[0])) {
+            ALOGV("Hint 0x%x: skipping resource 0x%08x of unknown cluster", id, opcode);
+            return;
+        }
+
+        bool known = false;
+        for (const auto& map : kResourceMap) {
+            if (map.major != major || map.minor != minor) {
+                continue;
+            }
+            known = true;
+
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), map.path, kClusterCpu[cluster]);
+            TunableNode* node = Tunables::get().node(path, map.combine);
+            if (!node) {
+                continue;
+            }
+
+            /*
+             * The perf HAL treats a zero floor or ceiling as no limit. Written as
+             * is, it would pin scaling_max_freq to the lowest frequency.
+             */
+            if (value == 0 && map.combine != TunableNode::LATEST) {
+                return;
+            }
+
+            /* Clusters sharing a node, such as a global governor, fold into one write. */
+            int64_t scaled = value * map.scale;
+            for (auto& action : hint->actions) {
+                if (action.node != node) {
+                    continue;
+                }
+                if (map.combine == TunableNode::MAX) {
+                    action.value = std::max(action.value, scaled);
+                } else if (map.combine == TunableNode::MIN) {
+                    action.value = std::min(action.value, scaled);
+                } else {
+                    action.value = scaled;
+                }
+                return;
+            }
+            hint->actions.push_back({node, scaled});
+            return;
+        }
+
+        if (known) {
+            ALOGW("Hint 0x%x: resource 0x%08x is not available", id, opcode);
+            return;
+        }
+        ALOGV("Hint 0x%x: skipping unsupported resource 0x%08x", id, opcode);
+    }
+
+    std::map<uint32_t, Hint> mHints;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
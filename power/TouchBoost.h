@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "BoostEngine.h"
+#include "InputDevice.h"
+
+#include <cutils/properties.h>
+#include <linux/input.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+static constexpr const char* kTouchBoostProp = "ro.vendor.power.touch_boost";
+static constexpr int32_t kTouchBoostMs = 200;
+
+/*
+ * Boosts on every finger down straight from the touchscreen's evdev node,
+ * ahead of the interaction hint that has to come through InputDispatcher,
+ * PowerManager and binder.
+ */
+static void installTouchBoost(TouchDevice& device) {
+    device.setHandler([](const struct input_event* ev, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (ev[i].type == EV_KEY && ev[i].code == BTN_TOUCH && ev[i].value == 1) {
+                BoostEngine::get().boost(BoostEngine::INTERACTION, kTouchBoostMs);
+                return;
+            }
+        }
+    });
+}
+
+/* Enabled by ro.vendor.power.touch_boost. */
+static bool startTouchBoost() {
+    if (!property_get_bool(kTouchBoostProp, false)) {
+        return false;
+    }
+
+    installTouchBoost(TouchDevice::get());
+    return true;
+}
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * TARGET_POWERHAL_MODE_EXT only adds power-mode.cpp to the QTI power HAL,
+ * so everything it uses lives in headers next to it.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+/*
+ * A sysfs tunable shared by every hint and boost that touches it. Each
+ * holder pushes a layer, the node is written with the combined value of the
+ * layers still held, and the value found before the first layer is put back
+ * once the last one is popped. Callers serialize through Tunables.
+ */
+class TunableNode {
+  public:
+    /* How the values of overlapping layers are combined. */
+    enum Combine : uint8_t {
+        MAX,    /* floors: the highest request wins */
+        MIN,    /* ceilings: the lowest request wins */
+        LATEST, /* plain tunables: the newest request wins */
+    };
+
+    TunableNode(std::string path, Combine combine)
+        : mPath(std::move(path)), mCombine(combine) {
+        mFd = open(mPath.c_str(), O_RDWR | O_CLOEXEC);
+        if (mFd < 0) {
+            ALOGE("Failed to open %s: %s", mPath.c_str(), strerror(errno));
+        }
+    }
+
+    ~TunableNode() {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    TunableNode(const TunableNode&) = delete;
+    TunableNode& operator=(const TunableNode&) = delete;
+
+    const std::string& path() const { return mPath; }
+    bool isOpen() const { return mFd >= 0; }
+
+    bool push(uint32_t owner, int64_t value) {
+        if (mLayers.empty() && !readSaved()) {
+            return false;
+        }
+        mLayers.emplace_back(owner, value);
+        return update();
+    }
+
+    bool pop(uint32_t owner) {
+        auto it = std::find_if(mLayers.rbegin(), mLayers.rend(),
+                               [owner](const auto& layer) { return layer.first == owner; });
+        if (it == mLayers.rend()) {
+            return false;
+        }
+        mLayers.erase(std::next(it).base());
+        return update();
+    }
+
+  private:
+    bool readSaved() {
+        char buf[64];
+        ssize_t len = pread(mFd, buf, sizeof(buf) - 1, 0);
+        if (len <= 0) {
+            ALOGE("Failed to read %s: %s", mPath.c_str(), len < 0 ? strerror(errno) : "empty");
+            return false;
+        }
+        mSaved.assign(buf, len);
+        while (!mSaved.empty() && (mSaved.back() == '\n' || mSaved.back() == ' ')) {
+            mSaved.pop_back();
+        }
+        return true;
+    }
+
+    bool update() {
+        if (mLayers.empty()) {
+            mWritten.clear();
+            return write(mSaved);
+        }
+
+        int64_t value = mLayers.back().second;
+        for (const auto& layer : mLayers) {
+            if (mCombine == MAX) {
+                value = std::max(value, layer.second);
+            } else if (mCombine == MIN) {
+                value = std::min(value, layer.second);
+            }
+        }
+
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%" PRId64, value);
+        return write(buf);
+    }
+
+    bool write(const std::string& value) {
+        /* Skip the syscall when the combined value did not change. */
+        if (value == mWritten) {
+            return true;
+        }
+        if (pwrite(mFd, value.c_str(), value.size(), 0) < 0) {
+            ALOGE("Failed to write %s to %s: %s", value.c_str(), mPath.c_str(), strerror(errno));
+            mWritten.clear();
+            return false;
+        }
+        mWritten = mLayers.empty() ? std::string() : value;
+        return true;
+    }
+
+    std::string mPath;
+    Combine mCombine;
+    int mFd{-1};
+    std::string mSaved;
+    std::string mWritten;
+    std::vector<std::pair<uint32_t, int64_t>> mLayers;
+};
+
+/*
+ * Every tunable the HAL writes, opened once and keyed by resolved path so
+ * that aliases, such as the cpuN/cpufreq links of the CPUs of one policy,
+ * end up on the same node.
+ */
+class Tunables {
+  public:
+    static Tunables& get() {
+        static Tunables sTunables;
+        return sTunables;
+    }
+
+    /* Returns nullptr when the node does not exist on this kernel. */
+    TunableNode* node(const std::string& path, TunableNode::Combine combine) {
+        char resolved[PATH_MAX];
+        if (!realpath(path.c_str(), resolved)) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        auto& node = mNodes[resolved];
+        if (!node) {
+            node = std::make_unique<TunableNode>(resolved, combine);
+        }
+        return node->isOpen() ? node.get() : nullptr;
+    }
+
+    std::mutex& lock() { return mLock; }
+
+  private:
+    Tunables() = default;
+
+    std::mutex mLock;
+    std::map<std::string, std::unique_ptr<TunableNode>> mNodes;
+};
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
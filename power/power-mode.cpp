@@ -14,9 +14,15 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "QTI PowerHAL"
+#define ATRACE_TAG ATRACE_TAG_POWER
+
 #include <aidl/android/hardware/power/BnPower.h>
-#include <android-base/file.h>
-#include <linux/input.h>
+
+#include "BoostEngine.h"
+#include "InputDevice.h"
+#include "PowerHint.h"
+#include "TouchBoost.h"
 
 namespace aidl {
 namespace android {
@@ -24,14 +30,102 @@ namespace hardware {
 namespace power {
 namespace impl {
 
-static constexpr int kInputEventWakeupModeOff = 4;
-static constexpr int kInputEventWakeupModeOn = 5;
+static constexpr const char* kPowerHintPath = "/vendor/etc/powerhint.xml";
+
+/* Upper bound on a launch boost in case the mode is never turned off. */
+static constexpr int32_t kLaunchBoostMaxMs = 5000;
 
 using ::aidl::android::hardware::power::Mode;
 
+/* Parsed once when the HAL is loaded. */
+static PowerHints sPowerHints(kPowerHintPath);
+static const bool sTouchBoost = startTouchBoost();
+
+static std::mutex sModeLock;
+static uint64_t sModes;
+
+static bool isModeEnabled(Mode type) {
+    return sModes & (1ULL << static_cast<int>(type));
+}
+
+/* powerhint.xml has a dedicated hint for VR together with sustained performance. */
+static std::vector<uint32_t> performanceHints(bool vr, bool sustained) {
+    if (vr && sustained) {
+        return {POWER_HINT_VR_SUSTAINED_PERFORMANCE};
+    }
+    std::vector<uint32_t> hints;
+    if (vr) {
+        hints.push_back(POWER_HINT_VR);
+    }
+    if (sustained) {
+        hints.push_back(POWER_HINT_SUSTAINED_PERFORMANCE);
+    }
+    return hints;
+}
+
+static uint32_t modeToHint(Mode type) {
+    switch (type) {
+        case Mode::SUSTAINED_PERFORMANCE:
+            return POWER_HINT_SUSTAINED_PERFORMANCE;
+        case Mode::VR:
+            return POWER_HINT_VR;
+        case Mode::CAMERA_STREAMING_LOW:
+        case Mode::CAMERA_STREAMING_MID:
+            return POWER_HINT_CAMERA_PREVIEW;
+        case Mode::CAMERA_STREAMING_HIGH:
+            return POWER_HINT_VIDEO_ENCODE;
+        default:
+            return 0;
+    }
+}
+
+static bool setHintMode(Mode type, bool enabled) {
+    std::lock_guard<std::mutex> lock(sModeLock);
+    if (isModeEnabled(type) == enabled) {
+        return true;
+    }
+
+    bool ok = true;
+    if (type == Mode::SUSTAINED_PERFORMANCE || type == Mode::VR) {
+        bool vr = isModeEnabled(Mode::VR);
+        bool sustained = isModeEnabled(Mode::SUSTAINED_PERFORMANCE);
+        std::vector<uint32_t> before = performanceHints(vr, sustained);
+        (type == Mode::VR ? vr : sustained) = enabled;
+        std::vector<uint32_t> after = performanceHints(vr, sustained);
+
+        for (uint32_t hint : before) {
+            if (std::find(after.begin(), after.end(), hint) == after.end()) {
+                ok &= sPowerHints.release(hint);
+            }
+        }
+        for (uint32_t hint : after) {
+            if (std::find(before.begin(), before.end(), hint) == before.end()) {
+                ok &= sPowerHints.apply(hint);
+            }
+        }
+    } else {
+        uint32_t hint = modeToHint(type);
+        ok = enabled ? sPowerHints.apply(hint) : sPowerHints.release(hint);
+    }
+
+    sModes ^= 1ULL << static_cast<int>(type);
+    return ok;
+}
+
 bool isDeviceSpecificModeSupported(Mode type, bool* _aidl_return) {
     switch (type) {
         case Mode::DOUBLE_TAP_TO_WAKE:
+        case Mode::LAUNCH:
+            *_aidl_return = true;
+            return true;
+        case Mode::SUSTAINED_PERFORMANCE:
+        case Mode::VR:
+        case Mode::CAMERA_STREAMING_LOW:
+        case Mode::CAMERA_STREAMING_MID:
+        case Mode::CAMERA_STREAMING_HIGH:
+            if (!sPowerHints.has(modeToHint(type))) {
+                return false;
+            }
             *_aidl_return = true;
             return true;
         default:
@@ -41,16 +135,24 @@ bool isDeviceSpecificModeSupported(Mode type, bool* _aidl_return) {
 
 bool setDeviceSpecificMode(Mode type, bool enabled) {
     switch (type) {
-        case Mode::DOUBLE_TAP_TO_WAKE: {
-            int fd = open("/dev/input/event2", O_RDWR);
-            struct input_event ev;
-            ev.type = EV_SYN;
-            ev.code = SYN_CONFIG;
-            ev.value = enabled ? kInputEventWakeupModeOn : kInputEventWakeupModeOff;
-            write(fd, &ev, sizeof(ev));
-            close(fd);
-        }
-	    return true;
+        case Mode::DOUBLE_TAP_TO_WAKE:
+            return TouchDevice::get().setWakeupMode(enabled);
+        case Mode::LAUNCH:
+            if (enabled) {
+                BoostEngine::get().boost(BoostEngine::LAUNCH, kLaunchBoostMaxMs);
+            } else {
+                BoostEngine::get().cancel(BoostEngine::LAUNCH);
+            }
+            return true;
+        case Mode::SUSTAINED_PERFORMANCE:
+        case Mode::VR:
+        case Mode::CAMERA_STREAMING_LOW:
+        case Mode::CAMERA_STREAMING_MID:
+        case Mode::CAMERA_STREAMING_HIGH:
+            if (!sPowerHints.has(modeToHint(type))) {
+                return false;
+            }
+            return setHintMode(type, enabled);
         default:
             return false;
     }
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "TouchBoost.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace power {
+namespace impl {
+
+namespace {
+
+static constexpr const char* kDeviceName = "onclite-touch-test";
+static constexpr auto kTimeout = std::chrono::seconds(2);
+static constexpr auto kPollInterval = std::chrono::milliseconds(10);
+
+/* A uinput device reporting BTN_TOUCH, standing in for the touchscreen. */
+class UinputTouchDevice {
+  public:
+    ~UinputTouchDevice() {
+        if (mFd >= 0) {
+            ioctl(mFd, UI_DEV_DESTROY);
+            close(mFd);
+        }
+    }
+
+    bool create() {
+        mFd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (mFd < 0) {
+            return false;
+        }
+
+        struct uinput_setup setup = {};
+        strncpy(setup.name, kDeviceName, sizeof(setup.name) - 1);
+        setup.id.bustype = BUS_VIRTUAL;
+
+        return ioctl(mFd, UI_SET_EVBIT, EV_KEY) >= 0 && ioctl(mFd, UI_SET_KEYBIT, BTN_TOUCH) >= 0 &&
+               ioctl(mFd, UI_DEV_SETUP, &setup) >= 0 && ioctl(mFd, UI_DEV_CREATE) >= 0;
+    }
+
+    /* A finger down and up, each in its own report. */
+    void tap() {
+        emit(EV_KEY, BTN_TOUCH, 1);
+        emit(EV_SYN, SYN_REPORT, 0);
+        emit(EV_KEY, BTN_TOUCH, 0);
+        emit(EV_SYN, SYN_REPORT, 0);
+    }
+
+  private:
+    void emit(uint16_t type, uint16_t code, int32_t value) {
+        struct input_event ev = {};
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        if (write(mFd, &ev, sizeof(ev)) != sizeof(ev)) {
+            ADD_FAILURE() << "Failed to write to uinput: " << strerror(errno);
+        }
+    }
+
+    int mFd{-1};
+};
+
+static bool isBoosted() {
+    return BoostEngine::get().isActive(BoostEngine::INTERACTION);
+}
+
+}  // anonymous namespace
+
+TEST(TouchBoostTest, BoostsOnTouchAndExpires) {
+    UinputTouchDevice uinput;
+    if (!uinput.create()) {
+        GTEST_SKIP() << "uinput is not available";
+    }
+
+    /* Never destroyed, the boost engine's thread keeps calling into it. */
+    static TouchDevice* sDevice = new TouchDevice(kDeviceName);
+    installTouchBoost(*sDevice);
+
+    /* The event node shows up asynchronously, keep tapping until one gets through. */
+    auto deadline = std::chrono::steady_clock::now() + kTimeout;
+    auto lastTap = std::chrono::steady_clock::now();
+    while (!isBoosted() && std::chrono::steady_clock::now() < deadline) {
+        lastTap = std::chrono::steady_clock::now();
+        uinput.tap();
+        std::this_thread::sleep_for(kPollInterval);
+    }
+    ASSERT_TRUE(isBoosted());
+
+    while (isBoosted() && std::chrono::steady_clock::now() < lastTap + kTimeout) {
+        std::this_thread::sleep_for(kPollInterval);
+    }
+    ASSERT_FALSE(isBoosted());
+
+    /* Boost timers never end early, so the last tap held it for the full duration. */
+    auto heldMs =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                  lastTap)
+                    .count();
+    EXPECT_GE(heldMs, kTouchBoostMs);
+}
+
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SysfsNode.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+SysfsNode::~SysfsNode() {
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool SysfsNode::open(const std::string& path) {
+    mPath = path;
+    return reopen();
+}
+
+bool SysfsNode::reopen() {
+    if (mFd >= 0) {
+        close(mFd);
+    }
+
+    mFd = TEMP_FAILURE_RETRY(::open(mPath.c_str(), O_WRONLY | O_CLOEXEC));
+    return mFd >= 0;
+}
+
+bool SysfsNode::write(const char* buf, size_t len) {
+    ssize_t expected = static_cast<ssize_t>(len);
+
+    if (mFd >= 0 && TEMP_FAILURE_RETRY(pwrite(mFd, buf, len, 0)) == expected) {
+        return true;
+    }
+
+    return reopen() && TEMP_FAILURE_RETRY(pwrite(mFd, buf, len, 0)) == expected;
+}
+
+bool SysfsNode::write(int64_t value) {
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%" PRId64, value);
+
+    return write(buf, len);
+}
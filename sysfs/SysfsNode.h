@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * A sysfs attribute kept open for writing. Values are written with pwrite()
+ * at offset 0, and the node is reopened once when a write fails, so a
+ * driver rebind does not leave a stale fd behind.
+ */
+class SysfsNode {
+  public:
+    SysfsNode() = default;
+    ~SysfsNode();
+
+    SysfsNode(const SysfsNode&) = delete;
+    SysfsNode& operator=(const SysfsNode&) = delete;
+
+    /* Close the current fd, if any, and open path. */
+    bool open(const std::string& path);
+    bool write(const char* buf, size_t len);
+    bool write(int64_t value);
+
+    const std::string& path() const { return mPath; }
+    bool isOpen() const { return mFd >= 0; }
+
+  private:
+    bool reopen();
+
+    std::string mPath;
+    int mFd{-1};
+};
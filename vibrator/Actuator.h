@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <aidl/android/hardware/vibrator/BnVibrator.h>
+
+#include "SysfsNode.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/* Drive levels are expressed in millivolts of the qpnp LDO whatever the backend. */
+static constexpr uint32_t QPNP_VIB_LDO_VMIN_MV = 1504;
+static constexpr uint32_t QPNP_VIB_LDO_VMAX_MV = 3544;
+static constexpr uint32_t MV_ADDITION_MAX = QPNP_VIB_LDO_VMAX_MV - QPNP_VIB_LDO_VMIN_MV;
+
+/*
+ * Hardware behind the vibrator. Only the actuator thread calls into it, so
+ * implementations need no locking.
+ */
+class Actuator {
+  public:
+    virtual ~Actuator() = default;
+
+    virtual const char* name() const = 0;
+    /* Vibrate at mv for ms, the hardware stops on its own afterwards. */
+    virtual bool drive(uint32_t mv, uint32_t ms) = 0;
+    virtual bool stop() = 0;
+    /* Change the level of the vibration in progress, or of the next one. */
+    virtual bool setVoltage(uint32_t mv) = 0;
+    /* Play an effect prepared ahead of time at mv, false if the backend cannot. */
+    virtual bool playEffect(Effect /* effect */, uint32_t /* mv */) { return false; }
+
+    /* When the level and the start of the last drive reached the hardware. */
+    int64_t voltageNs() const { return mVoltageNs; }
+    int64_t activateNs() const { return mActivateNs; }
+
+  protected:
+    int64_t mVoltageNs{0};
+    int64_t mActivateNs{0};
+};
+
+/* The qpnp LDO vibrator driven through /sys/class/leds/vibrator. */
+class LedActuator : public Actuator {
+  public:
+    LedActuator();
+
+    const char* name() const override { return "leds"; }
+    bool drive(uint32_t mv, uint32_t ms) override;
+    bool stop() override;
+    bool setVoltage(uint32_t mv) override;
+
+  private:
+    bool enable(bool enabled, uint32_t ms);
+
+    SysfsNode mActivate;
+    SysfsNode mDuration;
+    SysfsNode mState;
+    SysfsNode mVmaxMv;
+    /* Last voltage the LDO accepted, 0 when unknown. */
+    uint32_t mVoltageMv{0};
+};
+
+/*
+ * An evdev force-feedback device, such as ff-memless. Short effects are
+ * uploaded once with EVIOCSFF, playing one is then a single EV_FF write.
+ */
+class FfActuator : public Actuator {
+  public:
+    /* Open the first rumble-capable event device under dir and upload effects to it. */
+    static std::unique_ptr<FfActuator> probe(const std::map<Effect, uint32_t>& effects,
+                                             const std::string& dir = "/dev/input/");
+    ~FfActuator() override;
+
+    const char* name() const override { return "ff"; }
+    bool drive(uint32_t mv, uint32_t ms) override;
+    bool stop() override;
+    bool setVoltage(uint32_t mv) override;
+    bool playEffect(Effect effect, uint32_t mv) override;
+
+  private:
+    FfActuator(int fd, bool hasGain) : mFd(fd), mHasGain(hasGain) {}
+
+    struct PreparedEffect {
+        int16_t id;
+        uint32_t ms;
+    };
+
+    bool upload(int16_t* id, uint16_t magnitude, uint32_t ms);
+    bool play(int16_t id, uint32_t mv, uint32_t ms);
+
+    const int mFd;
+    const bool mHasGain;
+    /* Level set through FF_GAIN, or baked into the drive effect without it. */
+    uint16_t mMagnitude{0xFFFF};
+    int16_t mDriveId{-1};
+    int16_t mPlayingId{-1};
+    /* When the playing effect runs out, for level changes without FF_GAIN. */
+    int64_t mPlayEndNs{0};
+    std::map<Effect, PreparedEffect> mEffects;
+};
+
+/* The first force feedback device under inputDir, or the LED vibrator when there is none. */
+std::unique_ptr<Actuator> probeActuator(const std::map<Effect, uint32_t>& effects,
+                                        const std::string& inputDir = "/dev/input/");
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VibratorService"
+
+#include <log/log.h>
+
+#include "Actuator.h"
+#include "VibratorStats.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define BITS_PER_LONG   (sizeof(unsigned long) * 8)
+#define BITS_TO_LONGS(x) (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+static bool testBit(const unsigned long* bits, unsigned int bit) {
+    return bits[bit / BITS_PER_LONG] & (1UL << (bit % BITS_PER_LONG));
+}
+
+/* The LDO still vibrates at VMIN, so only 0 mV maps to a silent effect. */
+static uint16_t mvToMagnitude(uint32_t mv) {
+    if (mv == 0) {
+        return 0;
+    }
+    mv = std::clamp(mv, QPNP_VIB_LDO_VMIN_MV, QPNP_VIB_LDO_VMAX_MV);
+    return 1 + (mv - QPNP_VIB_LDO_VMIN_MV) * 0xFFFE / MV_ADDITION_MAX;
+}
+
+std::unique_ptr<FfActuator> FfActuator::probe(const std::map<Effect, uint32_t>& effects,
+                                              const std::string& dir) {
+    std::unique_ptr<DIR, decltype(&closedir)> inputDir(opendir(dir.c_str()), closedir);
+    if (!inputDir) {
+        return nullptr;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(inputDir.get())) != nullptr) {
+        if (strncmp(entry->d_name, "event", 5) != 0) {
+            continue;
+        }
+
+        std::string path = dir + entry->d_name;
+        int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CLOEXEC));
+        if (fd < 0) {
+            continue;
+        }
+
+        unsigned long ffBits[BITS_TO_LONGS(FF_CNT)] = {};
+        if (ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBits)), ffBits) < 0 ||
+            !testBit(ffBits, FF_RUMBLE)) {
+            close(fd);
+            continue;
+        }
+
+        std::unique_ptr<FfActuator> actuator(new FfActuator(fd, testBit(ffBits, FF_GAIN)));
+
+        /* The drive slot comes first so running out of slots only costs prepared effects. */
+        if (!actuator->upload(&actuator->mDriveId, 0xFFFF, 1)) {
+            continue;
+        }
+
+        for (const auto& [effect, ms] : effects) {
+            int16_t id = -1;
+            if (!actuator->upload(&id, 0xFFFF, ms)) {
+                break;
+            }
+            actuator->mEffects[effect] = {id, ms};
+        }
+
+        ALOGI("Using force feedback device %s, %zu effects uploaded", path.c_str(),
+              actuator->mEffects.size());
+        return actuator;
+    }
+
+    return nullptr;
+}
+
+std::unique_ptr<Actuator> probeActuator(const std::map<Effect, uint32_t>& effects,
+                                        const std::string& inputDir) {
+    std::unique_ptr<Actuator> actuator = FfActuator::probe(effects, inputDir);
+
+    if (!actuator) {
+        actuator = std::make_unique<LedActuator>();
+    }
+    return actuator;
+}
+
+FfActuator::~FfActuator() {
+    close(mFd);
+}
+
+bool FfActuator::drive(uint32_t mv, uint32_t ms) {
+    uint16_t magnitude = mHasGain ? 0xFFFF : mvToMagnitude(mv);
+
+    return upload(&mDriveId, magnitude, ms) && play(mDriveId, mv, ms);
+}
+
+bool FfActuator::stop() {
+    if (mPlayingId < 0) {
+        return true;
+    }
+
+    struct input_event event = {};
+    event.type = EV_FF;
+    event.code = mPlayingId;
+    event.value = 0;
+    mPlayingId = -1;
+
+    return TEMP_FAILURE_RETRY(write(mFd, &event, sizeof(event))) == sizeof(event);
+}
+
+bool FfActuator::setVoltage(uint32_t mv) {
+    uint16_t magnitude = mvToMagnitude(mv);
+
+    if (magnitude == mMagnitude) {
+        return true;
+    }
+    mMagnitude = magnitude;
+
+    /*
+     * Without FF_GAIN the level is baked into the effect, so one in progress
+     * is replaced by the drive slot at the new level for the rest of its time.
+     */
+    if (!mHasGain) {
+        int64_t remainingMs = (mPlayEndNs - nowNs()) / 1000000;
+
+        if (mPlayingId < 0 || remainingMs <= 0) {
+            return true;
+        }
+        return upload(&mDriveId, magnitude, remainingMs) && play(mDriveId, mv, remainingMs);
+    }
+
+    struct input_event event = {};
+    event.type = EV_FF;
+    event.code = FF_GAIN;
+    event.value = magnitude;
+
+    if (TEMP_FAILURE_RETRY(write(mFd, &event, sizeof(event))) != sizeof(event)) {
+        return false;
+    }
+
+    mVoltageNs = nowNs();
+    return true;
+}
+
+bool FfActuator::playEffect(Effect effect, uint32_t mv) {
+    auto it = mEffects.find(effect);
+    if (it == mEffects.end()) {
+        return false;
+    }
+
+    /* Prepared effects are uploaded at full strength, only FF_GAIN can play them softer. */
+    if (!mHasGain && mvToMagnitude(mv) != 0xFFFF) {
+        return false;
+    }
+
+    return play(it->second.id, mv, it->second.ms);
+}
+
+/* Upload a rumble effect, reusing the slot when *id is already allocated. */
+bool FfActuator::upload(int16_t* id, uint16_t magnitude, uint32_t ms) {
+    struct ff_effect effect = {};
+
+    effect.type = FF_RUMBLE;
+    effect.id = *id;
+    effect.replay.length = std::min<uint32_t>(ms, UINT16_MAX);
+    effect.u.rumble.strong_magnitude = magnitude;
+
+    if (ioctl(mFd, EVIOCSFF, &effect) < 0) {
+        ALOGE("Failed to upload force feedback effect: %s", strerror(errno));
+        return false;
+    }
+
+    *id = effect.id;
+    return true;
+}
+
+/* Set the gain and start the effect with a single write. */
+bool FfActuator::play(int16_t id, uint32_t mv, uint32_t ms) {
+    struct input_event events[2] = {};
+    size_t count = 0;
+    uint16_t magnitude = mvToMagnitude(mv);
+
+    if (mHasGain && magnitude != mMagnitude) {
+        events[count].type = EV_FF;
+        events[count].code = FF_GAIN;
+        events[count].value = magnitude;
+        count++;
+    }
+    mMagnitude = magnitude;
+
+    events[count].type = EV_FF;
+    events[count].code = id;
+    events[count].value = 1;
+    count++;
+
+    ssize_t len = count * sizeof(events[0]);
+    if (TEMP_FAILURE_RETRY(write(mFd, events, len)) != len) {
+        ALOGE("Failed to play force feedback effect: %s", strerror(errno));
+        return false;
+    }
+
+    mPlayingId = id;
+    mVoltageNs = mActivateNs = nowNs();
+    mPlayEndNs = mActivateNs + ms * 1000000LL;
+    return true;
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HapticEnvelope.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+float blockLevel(const int16_t* samples, size_t count) {
+    uint64_t sum = 0;
+    size_t i = 0;
+
+    if (count == 0) {
+        return 0.0f;
+    }
+
+#if defined(__ARM_NEON)
+    /* Eight samples per step, widened pairwise so 32-bit lanes cannot overflow a block. */
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(samples + i);
+        acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vqabsq_s16(v)));
+    }
+    sum = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+          static_cast<uint64_t>(vgetq_lane_u32(acc, 2)) + vgetq_lane_u32(acc, 3);
+#endif
+
+    for (; i < count; i++) {
+        sum += std::abs(static_cast<int32_t>(samples[i]));
+    }
+
+    return static_cast<float>(sum) / count / 32768.0f;
+}
+
+HapticEnvelope::HapticEnvelope(uint32_t sampleRate, float attackMs, float releaseMs)
+    : mSampleRate(sampleRate), mAttackMs(attackMs), mReleaseMs(releaseMs) {}
+
+float HapticEnvelope::process(const int16_t* samples, size_t count) {
+    float level = blockLevel(samples, count);
+    float blockMs = count * 1000.0f / mSampleRate;
+    float tau = level > mLevel ? mAttackMs : mReleaseMs;
+
+    /* One-pole coefficient for this block length, so any packet size gives the same response. */
+    float alpha = 1.0f - std::exp(-blockMs / tau);
+    mLevel += alpha * (level - mLevel);
+
+    return mLevel;
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
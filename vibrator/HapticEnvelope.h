@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/* The haptic channel's format and the follower's time constants. */
+static constexpr uint32_t HAPTIC_SAMPLE_RATE = 48000;
+static constexpr float HAPTIC_ATTACK_MS = 2.0f;
+static constexpr float HAPTIC_RELEASE_MS = 30.0f;
+
+/* Mean rectified level of a block of 16-bit PCM, 0.0 to 1.0 of full scale. */
+float blockLevel(const int16_t* samples, size_t count);
+
+/*
+ * Envelope follower for the haptic PCM channel. Each block is reduced to
+ * its mean rectified level, then smoothed with a one-pole low-pass using
+ * separate attack and release time constants, since the motor cannot
+ * follow anything faster anyway.
+ */
+class HapticEnvelope {
+  public:
+    HapticEnvelope(uint32_t sampleRate, float attackMs, float releaseMs);
+
+    /* Feed one block and return the smoothed level. */
+    float process(const int16_t* samples, size_t count);
+    void reset() { mLevel = 0.0f; }
+
+  private:
+    const float mSampleRate;
+    const float mAttackMs;
+    const float mReleaseMs;
+    float mLevel{0.0f};
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
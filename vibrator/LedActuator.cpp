@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VibratorService"
+#define ATRACE_TAG (ATRACE_TAG_VIBRATOR | ATRACE_TAG_HAL)
+
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include "Actuator.h"
+#include "VibratorStats.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+static const std::string kLedVibDeviceDir = "/sys/class/leds/vibrator/";
+static const std::string kLedVibDeviceActivateFile = kLedVibDeviceDir + "activate";
+static const std::string kLedVibDeviceDurationFile = kLedVibDeviceDir + "duration";
+static const std::string kLedVibDeviceStateFile = kLedVibDeviceDir + "state";
+static const std::string kLedVibDeviceVmaxMvFile = kLedVibDeviceDir + "vmax_mv";
+
+static void openNode(SysfsNode* node, const std::string& path) {
+    if (!node->open(path)) {
+        ALOGE("Failed to open %s!", path.c_str());
+    }
+}
+
+LedActuator::LedActuator() {
+    openNode(&mActivate, kLedVibDeviceActivateFile);
+    openNode(&mDuration, kLedVibDeviceDurationFile);
+    openNode(&mState, kLedVibDeviceStateFile);
+    openNode(&mVmaxMv, kLedVibDeviceVmaxMvFile);
+}
+
+bool LedActuator::drive(uint32_t mv, uint32_t ms) {
+    return setVoltage(mv) && enable(true, ms);
+}
+
+bool LedActuator::stop() {
+    return enable(false, 0);
+}
+
+bool LedActuator::setVoltage(uint32_t mv) {
+    /* The LDO keeps its voltage between effects, only reprogram it on a change. */
+    if (mv == mVoltageMv) {
+        mVoltageNs = nowNs();
+        return true;
+    }
+
+    if (!mVmaxMv.write(mv)) {
+        ALOGE("Failed to set amplitude!");
+        mVoltageMv = 0;
+        return false;
+    }
+
+    ATRACE_INT("vmax_mv", mv);
+    mVoltageMv = mv;
+    mVoltageNs = nowNs();
+    return true;
+}
+
+bool LedActuator::enable(bool enabled, uint32_t ms) {
+    const char* value = enabled ? "1" : "0";
+
+    if (!mState.write(value, 1) || !mDuration.write(ms) || !mActivate.write(value, 1)) {
+        ALOGE("Failed to enable vibration!");
+        return false;
+    }
+
+    if (enabled) {
+        mActivateNs = nowNs();
+    }
+    return true;
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
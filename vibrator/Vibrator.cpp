@@ -15,175 +15,793 @@
  */
 
 #define LOG_TAG "VibratorService"
+#define ATRACE_TAG (ATRACE_TAG_VIBRATOR | ATRACE_TAG_HAL)
 
-#include <android-base/file.h>
+#include <cutils/sockets.h>
 #include <log/log.h>
+#include <utils/Trace.h>
 
 #include "Vibrator.h"
 
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+namespace aidl {
 namespace android {
 namespace hardware {
 namespace vibrator {
-namespace V1_3 {
-namespace implementation {
 
-static const std::string kLedVibDeviceDir = "/sys/class/leds/vibrator/";
-static const std::string kLedVibDeviceActivateFile = kLedVibDeviceDir + "activate";
-static const std::string kLedVibDeviceDurationFile = kLedVibDeviceDir + "duration";
-static const std::string kLedVibDeviceStateFile = kLedVibDeviceDir + "state";
-static const std::string kLedVibDeviceVmaxMvFile = kLedVibDeviceDir + "vmax_mv";
+static constexpr int32_t COMPOSE_DELAY_MAX_MS = 1000;
+static constexpr int32_t COMPOSE_SIZE_MAX = 16;
+static constexpr uint32_t FF_EFFECT_MS_MAX = 100;
+
+/*
+ * External control reads 16-bit mono PCM at 48 kHz from the vibrator_haptics
+ * seqpacket socket, one block of up to 20 ms per packet.
+ */
+static constexpr const char* HAPTIC_SOCKET = "vibrator_haptics";
+static constexpr size_t HAPTIC_BLOCK_MAX = HAPTIC_SAMPLE_RATE / 50;
+/* Mean rectified level of a full scale sine is 2/pi, scale it back up to full drive. */
+static constexpr float HAPTIC_GAIN = 1.57f;
+static constexpr float HAPTIC_LEVEL_MIN = 0.02f;
+/* Each drive lasts this long, so the motor stops by itself if the stream stalls. */
+static constexpr uint32_t HAPTIC_HOLD_MS = 50;
+
+static int64_t nowMs() {
+    return nowNs() / 1000000;
+}
+
+/*
+ * Short effects are played as a kick at full voltage to spin the motor up,
+ * then a sustain at the requested strength, as one drive whose level drops
+ * once. The LDO cannot drive the motor backwards, so the drive simply ends
+ * on time and the motor rings down by itself.
+ */
+struct EffectEnvelope {
+    Effect effect;
+    uint8_t kickMs;
+    uint8_t sustainMs;
+};
+
+static constexpr EffectEnvelope kEffectEnvelopes[] = {
+    { Effect::CLICK,        4, 6 },
+    { Effect::DOUBLE_CLICK, 4, 11 },
+    { Effect::TICK,         3, 2 },
+    { Effect::TEXTURE_TICK, 3, 2 },
+    { Effect::THUD,         5, 5 },
+    { Effect::POP,          3, 2 },
+    { Effect::HEAVY_CLICK,  5, 8 },
+};
+
+static const EffectEnvelope* findEnvelope(Effect effect) {
+    for (const EffectEnvelope& envelope : kEffectEnvelopes) {
+        if (envelope.effect == effect) {
+            return &envelope;
+        }
+    }
+    return nullptr;
+}
+
+static uint32_t amplitudeToMv(uint32_t amplitude) {
+    return QPNP_VIB_LDO_VMIN_MV + amplitude * MV_ADDITION_MAX / 0xFF;
+}
+
+/*
+ * Primitive envelopes as (ms, amplitude) steps. The LDO only has a drive
+ * voltage, so rises and falls are approximated with a few voltage steps.
+ */
+struct PrimitiveStep {
+    uint32_t ms;
+    uint8_t amplitude;
+};
+
+static const std::vector<PrimitiveStep>* primitiveSteps(CompositePrimitive primitive) {
+    static const std::vector<PrimitiveStep> noop = {};
+    static const std::vector<PrimitiveStep> click = {{10, 255}};
+    static const std::vector<PrimitiveStep> thud = {{10, 255}, {20, 159}};
+    static const std::vector<PrimitiveStep> spin = {{20, 127}, {20, 191}, {20, 127}};
+    static const std::vector<PrimitiveStep> quickRise = {{8, 63}, {8, 127}, {8, 191}, {8, 255}};
+    static const std::vector<PrimitiveStep> slowRise = {{25, 42},  {25, 85},  {25, 127},
+                                                        {25, 170}, {25, 212}, {25, 255}};
+    static const std::vector<PrimitiveStep> quickFall = {{8, 255}, {8, 191}, {8, 127}, {8, 63}};
+    static const std::vector<PrimitiveStep> lightTick = {{5, 127}};
+    static const std::vector<PrimitiveStep> lowTick = {{5, 63}};
+
+    switch (primitive) {
+        case CompositePrimitive::NOOP:
+            return &noop;
+        case CompositePrimitive::CLICK:
+            return &click;
+        case CompositePrimitive::THUD:
+            return &thud;
+        case CompositePrimitive::SPIN:
+            return &spin;
+        case CompositePrimitive::QUICK_RISE:
+            return &quickRise;
+        case CompositePrimitive::SLOW_RISE:
+            return &slowRise;
+        case CompositePrimitive::QUICK_FALL:
+            return &quickFall;
+        case CompositePrimitive::LIGHT_TICK:
+            return &lightTick;
+        case CompositePrimitive::LOW_TICK:
+            return &lowTick;
+    }
+    return nullptr;
+}
+
+static void addNs(struct timespec* ts, uint64_t ns) {
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+Vibrator::Vibrator()
+    : mHapticEnvelope(HAPTIC_SAMPLE_RATE, HAPTIC_ATTACK_MS, HAPTIC_RELEASE_MS) {
+    std::map<Effect, uint32_t> effects;
+    std::vector<Effect> supported;
+
+    /* Only short effects are worth a force feedback slot, ringtones are driven directly. */
+    getSupportedEffects(&supported);
+    for (Effect effect : supported) {
+        bool valid = true;
+        uint32_t ms = effectToMs(effect, &valid);
+        if (valid && ms <= FF_EFFECT_MS_MAX) {
+            effects[effect] = ms;
+        }
+    }
 
-static constexpr uint32_t QPNP_VIB_LDO_VMIN_MV = 1504;
-static constexpr uint32_t QPNP_VIB_LDO_VMAX_MV = 3544;
-static constexpr uint32_t MV_ADDITION_MAX = QPNP_VIB_LDO_VMAX_MV - QPNP_VIB_LDO_VMIN_MV;
+    mBackend = probeActuator(effects);
+    ALOGI("Using %s actuator", mBackend->name());
 
-Vibrator::Vibrator() {}
+    mHapticListenFd = android_get_control_socket(HAPTIC_SOCKET);
+    if (mHapticListenFd < 0 || listen(mHapticListenFd, 1) < 0) {
+        ALOGW("No %s socket, external control will not play anything", HAPTIC_SOCKET);
+        mHapticListenFd = -1;
+    }
 
-// Methods from ::android::hardware::vibrator::V1_0::IVibrator follow.
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
 
-Return<Status> Vibrator::on(uint32_t timeoutMs) {
-    mHasEffect = false;
-    return enable(true, timeoutMs);
+    mActuator = std::thread(&Vibrator::actuatorLoop, this);
 }
 
-Return<Status> Vibrator::off() {
-    if (mHasEffect)
-        return Status::OK;
-    else
-        return enable(false, 0);
+ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
+    *_aidl_return = IVibrator::CAP_ON_CALLBACK | IVibrator::CAP_PERFORM_CALLBACK |
+                    IVibrator::CAP_AMPLITUDE_CONTROL | IVibrator::CAP_EXTERNAL_CONTROL |
+                    IVibrator::CAP_COMPOSE_EFFECTS;
+    return ndk::ScopedAStatus::ok();
 }
 
-Return<bool> Vibrator::supportsAmplitudeControl() {
-    return true;
+ndk::ScopedAStatus Vibrator::off() {
+    if (mState == State::EXTERNAL) {
+        ALOGW("Enabling/disabling while the vibrator is externally controlled is unsupported!");
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    enqueue({Command::STOP, {}, 0, nullptr});
+    return ndk::ScopedAStatus::ok();
 }
 
-Return<Status> Vibrator::setAmplitude(uint8_t amplitude) {
-    if (amplitude < 0) {
-        return Status::BAD_VALUE;
+ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
+                                const std::shared_ptr<IVibratorCallback>& callback) {
+    int64_t entryNs = nowNs();
+
+    if (timeoutMs <= 0) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
 
-    uint32_t mv_addition = amplitude * MV_ADDITION_MAX / 0xFF;
-    uint32_t mv = QPNP_VIB_LDO_VMIN_MV + mv_addition;
-    if (!android::base::WriteStringToFile(std::to_string(mv), kLedVibDeviceVmaxMvFile)) {
-        ALOGE("Failed to set amplitude!");
-        return Status::UNKNOWN_ERROR;
+    if (mState == State::EXTERNAL) {
+        ALOGW("Enabling/disabling while the vibrator is externally controlled is unsupported!");
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    uint32_t mv = amplitudeToMv(mAmplitude);
+    enqueue({Command::PLAY, {{static_cast<uint32_t>(timeoutMs), mv}}, 0, callback, std::nullopt,
+             STATS_ON, entryNs});
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength strength,
+                                     const std::shared_ptr<IVibratorCallback>& callback,
+                                     int32_t* _aidl_return) {
+    int64_t entryNs = nowNs();
+    bool supported = true;
+    uint8_t amplitude;
+    uint32_t ms;
+
+    ALOGV("Perform: Effect %s\n", toString(effect).c_str());
+
+    amplitude = strengthToAmplitude(strength, &supported);
+    ms = effectToMs(effect, &supported);
+    if (!supported) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+    ALOGV("ms = %u", ms);
+
+    if (mState == State::EXTERNAL) {
+        ALOGW("Enabling/disabling while the vibrator is externally controlled is unsupported!");
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
 
-    ALOGI("Amplitude: %u -> %u, mv = %u, mv_addition = %u\n",
-            mAmplitude, amplitude, mv, mv_addition);
     mAmplitude = amplitude;
-    return Status::OK;
+
+    uint32_t mv = amplitudeToMv(amplitude);
+    SegmentList segments;
+    const EffectEnvelope* envelope = findEnvelope(effect);
+    if (envelope != nullptr) {
+        segments = {
+            {envelope->kickMs, QPNP_VIB_LDO_VMAX_MV},
+            {envelope->sustainMs, mv, true},
+        };
+    } else {
+        segments = {{ms, mv}};
+    }
+    enqueue({Command::PLAY, segments, mv, callback, effect,
+             STATS_EFFECT + static_cast<size_t>(effect), entryNs});
+
+    *_aidl_return = ms;
+    return ndk::ScopedAStatus::ok();
 }
 
-Return<void> Vibrator::perform(V1_0::Effect effect, EffectStrength strength, perform_cb _hidl_cb) {
-    return perform<decltype(effect)>(effect, strength, _hidl_cb);
+ndk::ScopedAStatus Vibrator::getSupportedEffects(std::vector<Effect>* _aidl_return) {
+    *_aidl_return = {
+        Effect::CLICK,       Effect::DOUBLE_CLICK, Effect::TICK,        Effect::THUD,
+        Effect::POP,         Effect::HEAVY_CLICK,  Effect::RINGTONE_1,  Effect::RINGTONE_2,
+        Effect::RINGTONE_3,  Effect::RINGTONE_4,   Effect::RINGTONE_5,  Effect::RINGTONE_6,
+        Effect::RINGTONE_7,  Effect::RINGTONE_8,   Effect::RINGTONE_9,  Effect::RINGTONE_10,
+        Effect::RINGTONE_11, Effect::RINGTONE_12,  Effect::RINGTONE_13, Effect::RINGTONE_14,
+        Effect::RINGTONE_15, Effect::TEXTURE_TICK,
+    };
+    return ndk::ScopedAStatus::ok();
 }
 
-// Methods from ::android::hardware::vibrator::V1_1::IVibrator follow.
+ndk::ScopedAStatus Vibrator::setAmplitude(float amplitude) {
+    if (amplitude <= 0.0f || amplitude > 1.0f) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
 
-Return<void> Vibrator::perform_1_1(V1_1::Effect_1_1 effect, EffectStrength strength,
-                                   perform_cb _hidl_cb) {
-    return perform<decltype(effect)>(effect, strength, _hidl_cb);
+    mAmplitude = static_cast<uint8_t>(std::lround(amplitude * 0xFF));
+    enqueue({Command::AMPLITUDE, {}, amplitudeToMv(mAmplitude), nullptr});
+    return ndk::ScopedAStatus::ok();
 }
 
-// Methods from ::android::hardware::vibrator::V1_2::IVibrator follow.
+ndk::ScopedAStatus Vibrator::setExternalControl(bool enabled) {
+    State expected = enabled ? State::IDLE : State::EXTERNAL;
+
+    /* Stop first so the actuator is idle by the time control is handed over. */
+    if (enabled) {
+        enqueue({Command::STOP, {}, 0, nullptr});
+        expected = mState.exchange(State::EXTERNAL);
+    } else if (mState.compare_exchange_strong(expected, State::IDLE)) {
+        enqueue({Command::STOP, {}, 0, nullptr});
+    }
+
+    ALOGI("ExternalControl: %s -> %s\n", expected == State::EXTERNAL ? "true" : "false",
+            enabled ? "true" : "false");
+    return ndk::ScopedAStatus::ok();
+}
 
-Return<void> Vibrator::perform_1_2(V1_2::Effect effect, EffectStrength strength,
-                                   perform_cb _hidl_cb) {
-    return perform<decltype(effect)>(effect, strength, _hidl_cb);
+ndk::ScopedAStatus Vibrator::getCompositionDelayMax(int32_t* _aidl_return) {
+    *_aidl_return = COMPOSE_DELAY_MAX_MS;
+    return ndk::ScopedAStatus::ok();
 }
 
-// Methods from ::android::hardware::vibrator::V1_3::IVibrator follow.
+ndk::ScopedAStatus Vibrator::getCompositionSizeMax(int32_t* _aidl_return) {
+    *_aidl_return = COMPOSE_SIZE_MAX;
+    return ndk::ScopedAStatus::ok();
+}
 
-Return<bool> Vibrator::supportsExternalControl() {
-    return true;
+ndk::ScopedAStatus Vibrator::getSupportedPrimitives(
+        std::vector<CompositePrimitive>* _aidl_return) {
+    *_aidl_return = {
+        CompositePrimitive::NOOP,       CompositePrimitive::CLICK,
+        CompositePrimitive::THUD,       CompositePrimitive::SPIN,
+        CompositePrimitive::QUICK_RISE, CompositePrimitive::SLOW_RISE,
+        CompositePrimitive::QUICK_FALL, CompositePrimitive::LIGHT_TICK,
+        CompositePrimitive::LOW_TICK,
+    };
+    return ndk::ScopedAStatus::ok();
 }
 
-Return<Status> Vibrator::setExternalControl(bool enabled) {
-    ALOGI("ExternalControl: %s -> %s\n", mExternalControl ? "true" : "false",
-            enabled ? "true" : "false");
-    mExternalControl = enabled;
-    return Status::OK;
+ndk::ScopedAStatus Vibrator::getPrimitiveDuration(CompositePrimitive primitive,
+                                                  int32_t* _aidl_return) {
+    const std::vector<PrimitiveStep>* steps = primitiveSteps(primitive);
+    if (steps == nullptr) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    int32_t ms = 0;
+    for (const PrimitiveStep& step : *steps) {
+        ms += step.ms;
+    }
+
+    *_aidl_return = ms;
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Vibrator::compose(const std::vector<CompositeEffect>& composite,
+                                     const std::shared_ptr<IVibratorCallback>& callback) {
+    int64_t entryNs = nowNs();
+    SegmentList segments;
+
+    if (composite.empty() || composite.size() > COMPOSE_SIZE_MAX) {
+        return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    for (const CompositeEffect& effect : composite) {
+        if (effect.delayMs < 0 || effect.delayMs > COMPOSE_DELAY_MAX_MS ||
+            effect.scale < 0.0f || effect.scale > 1.0f) {
+            return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+        }
+
+        const std::vector<PrimitiveStep>* steps = primitiveSteps(effect.primitive);
+        if (steps == nullptr) {
+            return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+        }
+
+        if (effect.delayMs > 0 &&
+            !segments.push_back({static_cast<uint32_t>(effect.delayMs), 0})) {
+            return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+        }
+
+        for (const PrimitiveStep& step : *steps) {
+            uint32_t amplitude = std::lround(step.amplitude * effect.scale);
+            if (!segments.push_back({step.ms, amplitude > 0 ? amplitudeToMv(amplitude) : 0})) {
+                return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+            }
+        }
+    }
+
+    if (mState == State::EXTERNAL) {
+        ALOGW("Composing while the vibrator is externally controlled is unsupported!");
+        return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    enqueue({Command::PLAY, segments, 0, callback, std::nullopt, STATS_COMPOSE,
+             entryNs});
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus Vibrator::getSupportedAlwaysOnEffects(std::vector<Effect>* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::alwaysOnEnable(int32_t /* id */, Effect /* effect */,
+                                            EffectStrength /* strength */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::alwaysOnDisable(int32_t /* id */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
 }
 
-Return<void> Vibrator::perform_1_3(Effect effect, EffectStrength strength, perform_cb _hidl_cb) {
-    return perform<decltype(effect)>(effect, strength, _hidl_cb);
+ndk::ScopedAStatus Vibrator::getResonantFrequency(float* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getQFactor(float* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getFrequencyResolution(float* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getFrequencyMinimum(float* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getBandwidthAmplitudeMap(std::vector<float>* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getPwlePrimitiveDurationMax(int32_t* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getPwleCompositionSizeMax(int32_t* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::getSupportedBraking(std::vector<Braking>* /* _aidl_return */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+ndk::ScopedAStatus Vibrator::composePwle(const std::vector<PrimitivePwle>& /* composite */,
+                                         const std::shared_ptr<IVibratorCallback>& /* callback */) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+}
+
+binder_status_t Vibrator::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    static const char* const states[] = {"idle", "playing", "external"};
+
+    dprintf(fd, "Actuator: %s\n", mBackend->name());
+    dprintf(fd, "State: %s\n", states[static_cast<size_t>(mState.load())]);
+    dprintf(fd, "On time: %" PRIu64 " ms\n", mOnTimeUs.load() / 1000);
+    dprintf(fd, "Energy: %" PRIu64 " mV*s\n", mEnergyMvUs.load() / 1000000);
+
+    dprintf(fd, "\nPlaybacks:\n");
+    for (size_t kind = 0; kind < STATS_KINDS; kind++) {
+        const EffectStats& stats = mStats[kind];
+        uint64_t count = stats.count.load();
+
+        if (!count) {
+            continue;
+        }
+
+        dprintf(fd, "  %-14s count %" PRIu64 "\n", statsKindName(kind).c_str(), count);
+        stats.voltage.dump(fd, "voltage");
+        stats.activate.dump(fd, "activate");
+        stats.end.dump(fd, "end");
+    }
+
+    return STATUS_OK;
 }
 
 // Private methods follow.
 
-Return<void> Vibrator::perform(Effect effect, EffectStrength strength, perform_cb _hidl_cb) {
-    uint8_t amplitude;
-    uint32_t ms;
-    Status status = Status::OK;
+void Vibrator::enqueue(const Command& command) {
+    std::shared_ptr<IVibratorCallback> dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(mQueueLock);
 
-    ALOGI("Perform: Effect %s\n", effectToName(effect).c_str());
-    mHasEffect = true;
+        /* The actuator thread is a whole ring behind, the oldest command goes. */
+        if (mQueueCount == QUEUE_MAX) {
+            Command& oldest = mQueue[mQueueHead];
 
-    amplitude = strengthToAmplitude(strength, &status);
-    if (status != Status::OK) {
-        _hidl_cb(status, 0);
-        return Void();
+            ALOGW("Vibrator command queue full, dropping the oldest command");
+            dropped = std::move(oldest.callback);
+            oldest.callback = nullptr;
+            mQueueHead = (mQueueHead + 1) % QUEUE_MAX;
+            mQueueCount--;
+        }
+
+        mQueue[(mQueueHead + mQueueCount) % QUEUE_MAX] = command;
+        mQueueCount++;
     }
-    setAmplitude(amplitude);
 
-    ms = effectToMs(effect, &status);
-    ALOGI("ms = %u", ms);
-    if (status != Status::OK) {
-        _hidl_cb(status, 0);
-        return Void();
+    if (dropped) {
+        dropped->onComplete();
     }
-    status = enable(true, ms);
 
-    _hidl_cb(status, ms);
+    uint64_t one = 1;
+    TEMP_FAILURE_RETRY(write(mWakeFd, &one, sizeof(one)));
+}
+
+void Vibrator::actuatorLoop() {
+    struct pollfd fds[] = {
+        { mWakeFd, POLLIN, 0 },
+        { mTimerFd, POLLIN, 0 },
+        { mHapticListenFd, POLLIN, 0 },
+        { -1, POLLIN, 0 },
+    };
+    uint64_t count;
+
+    for (;;) {
+        fds[3].fd = mHapticFd;
+
+        if (TEMP_FAILURE_RETRY(poll(fds, 4, -1)) < 0) {
+            ALOGE("failed to poll: %s", strerror(errno));
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            size_t batch;
+
+            TEMP_FAILURE_RETRY(read(mWakeFd, &count, sizeof(count)));
+
+            {
+                std::lock_guard<std::mutex> lock(mQueueLock);
+                batch = mQueueCount;
+                for (size_t i = 0; i < batch; i++) {
+                    mBatch[i] = std::move(mQueue[(mQueueHead + i) % QUEUE_MAX]);
+                }
+                mQueueHead = (mQueueHead + batch) % QUEUE_MAX;
+                mQueueCount = 0;
+            }
+
+            /* A play followed by another play or a stop in the same batch never starts. */
+            bool superseded[QUEUE_MAX] = {};
+            bool later = false;
+            for (size_t i = batch; i-- > 0;) {
+                if (mBatch[i].op == Command::AMPLITUDE) {
+                    continue;
+                }
+                superseded[i] = later;
+                later = true;
+            }
+
+            for (size_t i = 0; i < batch; i++) {
+                Command& command = mBatch[i];
+
+                switch (command.op) {
+                    case Command::PLAY:
+                        finish();
+                        if (superseded[i] || mState == State::EXTERNAL) {
+                            if (command.callback) {
+                                command.callback->onComplete();
+                            }
+                            break;
+                        }
+                        mSegments = command.segments;
+                        mCallback = std::move(command.callback);
+                        mSegment = 0;
+                        mPlayKind = command.kind;
+                        mPlayEntryNs = command.entryNs;
+                        mPlayRecorded = false;
+                        mStats[mPlayKind].count++;
+                        clock_gettime(CLOCK_MONOTONIC, &mSegmentEnd);
+                        /* A prepared effect stands in for the first drive, level steps still apply. */
+                        if (command.effect && !mSegments.empty() &&
+                            mBackend->playEffect(*command.effect, mSegments[0].mv)) {
+                            mPrepared = true;
+                            driveStarted(mSegments[0].mv, mSegments.driveMs(0));
+                        }
+                        {
+                            State idle = State::IDLE;
+                            mState.compare_exchange_strong(idle, State::PLAYING);
+                        }
+                        startSegment();
+                        break;
+                    case Command::STOP:
+                        finish();
+                        stopHaptics();
+                        mBackend->stop();
+                        accountDrive(nowNs());
+                        break;
+                    case Command::AMPLITUDE:
+                        if (mState != State::EXTERNAL && mBackend->setVoltage(command.mv)) {
+                            levelChanged(command.mv);
+                        }
+                        break;
+                }
+
+                command.callback = nullptr;
+            }
+        }
+
+        if ((fds[1].revents & POLLIN) &&
+            TEMP_FAILURE_RETRY(read(mTimerFd, &count, sizeof(count))) == sizeof(count)) {
+            mSegment++;
+            startSegment();
+        }
 
-    return Void();
+        if (fds[2].revents & POLLIN) {
+            acceptHaptics();
+        }
+
+        if (fds[3].revents & (POLLIN | POLLHUP | POLLERR)) {
+            readHaptics();
+        }
+    }
 }
 
-template <typename T>
-Return<void> Vibrator::perform(T effect, EffectStrength strength, perform_cb _hidl_cb) {
-    auto validRange = hidl_enum_range<T>();
-    if (effect < *validRange.begin() || effect > *std::prev(validRange.end())) {
-        _hidl_cb(Status::UNSUPPORTED_OPERATION, 0);
-        return Void();
+/*
+ * Program the actuator for the current segment and arm the timer for its
+ * end. Boundaries are absolute, so per-segment latency does not accumulate.
+ */
+void Vibrator::startSegment() {
+    for (; mSegment < mSegments.size(); mSegment++) {
+        const Segment& segment = mSegments[mSegment];
+
+        if (segment.ms == 0) {
+            continue;
+        }
+
+        if (mState != State::EXTERNAL) {
+            if (segment.level) {
+                if (mBackend->setVoltage(segment.mv)) {
+                    levelChanged(segment.mv);
+                }
+            } else if (segment.mv > 0 && !mPrepared) {
+                uint32_t ms = mSegments.driveMs(mSegment);
+                if (mBackend->drive(segment.mv, ms)) {
+                    driveStarted(segment.mv, ms);
+                }
+            }
+        }
+        mPrepared = false;
+
+        struct itimerspec spec = {};
+        addNs(&mSegmentEnd, segment.ms * 1000000ULL);
+        spec.it_value = mSegmentEnd;
+
+        if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+            ALOGE("failed to arm segment timer: %s", strerror(errno));
+            break;
+        }
+        return;
+    }
+
+    if (!mSegments.empty()) {
+        int64_t endNs = mSegmentEnd.tv_sec * 1000000000LL + mSegmentEnd.tv_nsec;
+        mStats[mPlayKind].end.record(nowNs() - endNs);
     }
-    return perform(static_cast<Effect>(effect), strength, _hidl_cb);
+
+    finish();
 }
 
-Status Vibrator::enable(bool enabled, uint32_t ms) {
-    if (mExternalControl) {
-        ALOGW("Enabling/disabling while the vibrator is externally controlled is unsupported!");
-        return Status::UNSUPPORTED_OPERATION;
-    } else {
-        if (!android::base::WriteStringToFile(enabled ? "1" : "0", kLedVibDeviceStateFile) ||
-            !android::base::WriteStringToFile(std::to_string(ms), kLedVibDeviceDurationFile) ||
-            !android::base::WriteStringToFile(enabled ? "1" : "0", kLedVibDeviceActivateFile)) {
-            ALOGE("Failed to enable vibration!");
-            return Status::UNKNOWN_ERROR;
+void Vibrator::finish() {
+    struct itimerspec spec = {};
+    State playing = State::PLAYING;
+
+    timerfd_settime(mTimerFd, 0, &spec, nullptr);
+    accountDrive(nowNs());
+    mPlayRecorded = true;
+
+    mSegments.clear();
+    mSegment = 0;
+    mPrepared = false;
+    mState.compare_exchange_strong(playing, State::IDLE);
+
+    if (mCallback) {
+        std::shared_ptr<IVibratorCallback> callback = std::move(mCallback);
+        mCallback = nullptr;
+        callback->onComplete();
+    }
+}
+
+/* A new client replaces the previous one, only one stream is played at a time. */
+void Vibrator::acceptHaptics() {
+    int fd = TEMP_FAILURE_RETRY(accept4(mHapticListenFd, nullptr, nullptr,
+                                        SOCK_CLOEXEC | SOCK_NONBLOCK));
+    if (fd < 0) {
+        return;
+    }
+
+    if (mHapticFd >= 0) {
+        close(mHapticFd);
+    }
+    mHapticFd = fd;
+    mHapticEnvelope.reset();
+    mStats[STATS_EXTERNAL].count++;
+}
+
+void Vibrator::readHaptics() {
+    int16_t samples[HAPTIC_BLOCK_MAX];
+    ssize_t len = TEMP_FAILURE_RETRY(recv(mHapticFd, samples, sizeof(samples), 0));
+
+    if (len < 0 && errno == EAGAIN) {
+        return;
+    }
+
+    if (len <= 0) {
+        close(mHapticFd);
+        mHapticFd = -1;
+        if (mState == State::EXTERNAL) {
+            stopHaptics();
+            mBackend->stop();
+            accountDrive(nowNs());
         }
-        return Status::OK;
+        return;
     }
+
+    /* Keep draining the socket, but the stream only drives the motor under external control. */
+    if (mState != State::EXTERNAL) {
+        return;
+    }
+
+    driveHaptics(mHapticEnvelope.process(samples, len / sizeof(samples[0])));
 }
 
-const std::string Vibrator::effectToName(Effect effect) {
-    return toString(effect);
+/*
+ * Follow the envelope with the LDO voltage. The drive is renewed every half
+ * hold period; in between only the voltage is updated, which is a no-op
+ * when it did not change.
+ */
+void Vibrator::driveHaptics(float level) {
+    if (level < HAPTIC_LEVEL_MIN) {
+        if (mHapticDriving) {
+            mBackend->stop();
+            accountDrive(nowNs());
+            mHapticDriving = false;
+        }
+        return;
+    }
+
+    uint32_t mv = QPNP_VIB_LDO_VMIN_MV + std::min(level * HAPTIC_GAIN, 1.0f) * MV_ADDITION_MAX;
+    int64_t now = nowMs();
+
+    if (!mHapticDriving || now >= mHapticDriveEndMs - HAPTIC_HOLD_MS / 2) {
+        if (mBackend->drive(mv, HAPTIC_HOLD_MS)) {
+            driveStarted(mv, HAPTIC_HOLD_MS);
+        }
+        mHapticDriveEndMs = now + HAPTIC_HOLD_MS;
+        mHapticDriving = true;
+    } else if (mBackend->setVoltage(mv)) {
+        levelChanged(mv);
+    }
 }
 
-uint32_t Vibrator::effectToMs(Effect effect, Status* status) {
+void Vibrator::stopHaptics() {
+    mHapticEnvelope.reset();
+    mHapticDriving = false;
+}
+
+/*
+ * A drive reached the hardware. The first one of a playback closes its
+ * latency samples, and the previous drive is accounted up to now.
+ */
+void Vibrator::driveStarted(uint32_t mv, uint32_t ms) {
+    int64_t now = nowNs();
+
+    accountDrive(now);
+    mDriveMv = mv;
+    mDriveStartNs = now;
+    mDriveEndNs = now + ms * 1000000LL;
+
+    if (!mPlayRecorded) {
+        EffectStats& stats = mStats[mPlayKind];
+        int64_t activateNs = mBackend->activateNs() - mPlayEntryNs;
+
+        stats.voltage.record(mBackend->voltageNs() - mPlayEntryNs);
+        stats.activate.record(activateNs);
+        ATRACE_INT("vib_activate_us", activateNs / 1000);
+        mPlayRecorded = true;
+    }
+}
+
+/* The level of the drive in progress changed, it keeps its end. */
+void Vibrator::levelChanged(uint32_t mv) {
+    if (mDriveMv == 0) {
+        return;
+    }
+
+    int64_t now = nowNs();
+    int64_t endNs = mDriveEndNs;
+
+    accountDrive(now);
+    if (now < endNs) {
+        mDriveMv = mv;
+        mDriveStartNs = now;
+        mDriveEndNs = endNs;
+    }
+}
+
+/*
+ * Add the drive in progress, up to now or its scheduled end, to the on-time
+ * and energy totals. Energy is estimated as on-time times programmed voltage.
+ */
+void Vibrator::accountDrive(int64_t now) {
+    if (mDriveMv == 0) {
+        return;
+    }
+
+    int64_t endNs = std::min(now, mDriveEndNs);
+    if (endNs > mDriveStartNs) {
+        uint64_t us = (endNs - mDriveStartNs) / 1000;
+
+        mOnTimeUs += us;
+        mEnergyMvUs += mDriveMv * us;
+        ATRACE_INT64("vib_on_time_ms", mOnTimeUs / 1000);
+        ATRACE_INT64("vib_energy_mVs", mEnergyMvUs / 1000000);
+    }
+    mDriveMv = 0;
+}
+
+uint32_t Vibrator::effectToMs(Effect effect, bool* supported) {
     switch (effect) {
         case Effect::CLICK:
-            return 10;
         case Effect::DOUBLE_CLICK:
-            return 15;
         case Effect::TICK:
         case Effect::TEXTURE_TICK:
-            return 5;
         case Effect::THUD:
-            return 5;
         case Effect::POP:
-            return 5;
-        case Effect::HEAVY_CLICK:
-            return 10;
+        case Effect::HEAVY_CLICK: {
+            const EffectEnvelope* envelope = findEnvelope(effect);
+            return envelope->kickMs + envelope->sustainMs;
+        }
         case Effect::RINGTONE_1:
             return 30000;
         case Effect::RINGTONE_2:
@@ -215,11 +833,11 @@ uint32_t Vibrator::effectToMs(Effect effect, Status* status) {
         case Effect::RINGTONE_15:
             return 30000;
     }
-    *status = Status::UNSUPPORTED_OPERATION;
+    *supported = false;
     return 0;
 }
 
-uint8_t Vibrator::strengthToAmplitude(EffectStrength strength, Status* status) {
+uint8_t Vibrator::strengthToAmplitude(EffectStrength strength, bool* supported) {
     switch (strength) {
         case EffectStrength::LIGHT:
             return 63;
@@ -228,12 +846,11 @@ uint8_t Vibrator::strengthToAmplitude(EffectStrength strength, Status* status) {
         case EffectStrength::STRONG:
             return 255;
     }
-    *status = Status::UNSUPPORTED_OPERATION;
+    *supported = false;
     return 0;
 }
 
-}  // namespace implementation
-}  // namespace V1_3
 }  // namespace vibrator
 }  // namespace hardware
 }  // namespace android
+}  // namespace aidl
@@ -13,66 +13,220 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#ifndef ANDROID_HARDWARE_VIBRATOR_V1_3_VIBRATOR_H
-#define ANDROID_HARDWARE_VIBRATOR_V1_3_VIBRATOR_H
+#pragma once
 
-#include <android/hardware/vibrator/1.3/IVibrator.h>
-#include <hidl/Status.h>
+#include <aidl/android/hardware/vibrator/BnVibrator.h>
 
+#include "Actuator.h"
+#include "HapticEnvelope.h"
+#include "VibratorStats.h"
+
+#include <array>
+#include <atomic>
+#include <ctime>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl {
 namespace android {
 namespace hardware {
 namespace vibrator {
-namespace V1_3 {
-namespace implementation {
 
-using android::hardware::vibrator::V1_0::EffectStrength;
-using android::hardware::vibrator::V1_0::Status;
+/*
+ * One step of a composition: drive the LDO at mv for ms, or stay idle when
+ * mv is 0. A level step only moves the drive started before it to mv, that
+ * drive lasts through all the level steps following it.
+ */
+struct Segment {
+    uint32_t ms;
+    uint32_t mv;
+    bool level{false};
+};
+
+/* Enough for a full composition, COMPOSE_SIZE_MAX primitives with a delay and six steps each. */
+static constexpr size_t SEGMENTS_MAX = 16 * 7;
 
-class Vibrator : public IVibrator {
+/*
+ * The segments of one playback, stored in place so that building and
+ * queueing a command never touches the heap.
+ */
+class SegmentList {
   public:
-    Vibrator();
+    SegmentList() = default;
+    SegmentList(std::initializer_list<Segment> segments) {
+        for (const Segment& segment : segments) {
+            push_back(segment);
+        }
+    }
 
-    // Methods from ::android::hardware::vibrator::V1_0::IVibrator follow.
-    Return<Status> on(uint32_t timeoutMs) override;
-    Return<Status> off() override;
-    Return<bool> supportsAmplitudeControl() override;
-    Return<Status> setAmplitude(uint8_t amplitude) override;
-    Return<void> perform(V1_0::Effect effect, EffectStrength strength,
-                         perform_cb _hidl_cb) override;
+    /* Returns false, dropping the segment, when the list is full. */
+    bool push_back(const Segment& segment) {
+        if (mCount == SEGMENTS_MAX) {
+            return false;
+        }
+        mSegments[mCount++] = segment;
+        return true;
+    }
 
-    // Methods from ::android::hardware::vibrator::V1_1::IVibrator follow.
-    Return<void> perform_1_1(V1_1::Effect_1_1 effect, EffectStrength strength,
-                             perform_cb _hidl_cb) override;
+    void clear() { mCount = 0; }
+    bool empty() const { return mCount == 0; }
+    size_t size() const { return mCount; }
 
-    // Methods from ::android::hardware::vibrator::V1_2::IVibrator follow.
-    Return<void> perform_1_2(V1_2::Effect effect, EffectStrength strength,
-                             perform_cb _hidl_cb) override;
+    const Segment& operator[](size_t index) const { return mSegments[index]; }
 
-    // Methods from ::android::hardware::vibrator::V1_3::IVibrator follow.
-    Return<bool> supportsExternalControl() override;
-    Return<Status> setExternalControl(bool enabled) override;
-    Return<void> perform_1_3(Effect effect, EffectStrength strength, perform_cb _hidl_cb) override;
+    /* The length of the drive started at index, including the level steps after it. */
+    uint32_t driveMs(size_t index) const {
+        uint32_t ms = mSegments[index].ms;
+        while (++index < mCount && mSegments[index].level) {
+            ms += mSegments[index].ms;
+        }
+        return ms;
+    }
+    const Segment* begin() const { return mSegments.data(); }
+    const Segment* end() const { return mSegments.data() + mCount; }
 
   private:
-    Return<void> perform(Effect effect, EffectStrength strength, perform_cb _hidl_cb);
-    template <typename T>
-    Return<void> perform(T effect, EffectStrength strength, perform_cb _hidl_cb);
-    Status enable(bool enabled, uint32_t ms);
+    std::array<Segment, SEGMENTS_MAX> mSegments;
+    size_t mCount{0};
+};
+
+class Vibrator : public BnVibrator {
+  public:
+    Vibrator();
+
+    ndk::ScopedAStatus getCapabilities(int32_t* _aidl_return) override;
+    ndk::ScopedAStatus off() override;
+    ndk::ScopedAStatus on(int32_t timeoutMs,
+                          const std::shared_ptr<IVibratorCallback>& callback) override;
+    ndk::ScopedAStatus perform(Effect effect, EffectStrength strength,
+                               const std::shared_ptr<IVibratorCallback>& callback,
+                               int32_t* _aidl_return) override;
+    ndk::ScopedAStatus getSupportedEffects(std::vector<Effect>* _aidl_return) override;
+    ndk::ScopedAStatus setAmplitude(float amplitude) override;
+    ndk::ScopedAStatus setExternalControl(bool enabled) override;
+    ndk::ScopedAStatus getCompositionDelayMax(int32_t* _aidl_return) override;
+    ndk::ScopedAStatus getCompositionSizeMax(int32_t* _aidl_return) override;
+    ndk::ScopedAStatus getSupportedPrimitives(
+            std::vector<CompositePrimitive>* _aidl_return) override;
+    ndk::ScopedAStatus getPrimitiveDuration(CompositePrimitive primitive,
+                                            int32_t* _aidl_return) override;
+    ndk::ScopedAStatus compose(const std::vector<CompositeEffect>& composite,
+                               const std::shared_ptr<IVibratorCallback>& callback) override;
+    ndk::ScopedAStatus getSupportedAlwaysOnEffects(std::vector<Effect>* _aidl_return) override;
+    ndk::ScopedAStatus alwaysOnEnable(int32_t id, Effect effect, EffectStrength strength) override;
+    ndk::ScopedAStatus alwaysOnDisable(int32_t id) override;
+    ndk::ScopedAStatus getResonantFrequency(float* _aidl_return) override;
+    ndk::ScopedAStatus getQFactor(float* _aidl_return) override;
+    ndk::ScopedAStatus getFrequencyResolution(float* _aidl_return) override;
+    ndk::ScopedAStatus getFrequencyMinimum(float* _aidl_return) override;
+    ndk::ScopedAStatus getBandwidthAmplitudeMap(std::vector<float>* _aidl_return) override;
+    ndk::ScopedAStatus getPwlePrimitiveDurationMax(int32_t* _aidl_return) override;
+    ndk::ScopedAStatus getPwleCompositionSizeMax(int32_t* _aidl_return) override;
+    ndk::ScopedAStatus getSupportedBraking(std::vector<Braking>* _aidl_return) override;
+    ndk::ScopedAStatus composePwle(const std::vector<PrimitivePwle>& composite,
+                                   const std::shared_ptr<IVibratorCallback>& callback) override;
 
-    static const std::string effectToName(Effect effect);
-    static uint32_t effectToMs(Effect effect, Status* status);
-    static uint8_t strengthToAmplitude(EffectStrength strength, Status* status);
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
 
   private:
-    uint8_t mAmplitude{UINT8_MAX};
-    bool mHasEffect{false};
-    bool mExternalControl{false};
-    std::mutex mMutex;
+    /* Device state, written by binder threads and the actuator thread. */
+    enum class State : uint8_t {
+        IDLE,
+        PLAYING,
+        EXTERNAL,
+    };
+
+    /* Work handed from a binder thread to the actuator thread. */
+    struct Command {
+        enum Op : uint8_t {
+            PLAY,
+            STOP,
+            AMPLITUDE,
+        } op;
+        SegmentList segments;
+        uint32_t mv;
+        std::shared_ptr<IVibratorCallback> callback;
+        /* Set when the play comes from perform(), for backends with prepared effects. */
+        std::optional<Effect> effect;
+        size_t kind;
+        /* CLOCK_MONOTONIC time the binder call came in. */
+        int64_t entryNs;
+    };
+
+    void enqueue(const Command& command);
+
+    void actuatorLoop();
+    void startSegment();
+    void finish();
+
+    void acceptHaptics();
+    void readHaptics();
+    void driveHaptics(float level);
+    void stopHaptics();
+
+    void driveStarted(uint32_t mv, uint32_t ms);
+    void levelChanged(uint32_t mv);
+    void accountDrive(int64_t now);
+
+    static uint32_t effectToMs(Effect effect, bool* supported);
+    static uint8_t strengthToAmplitude(EffectStrength strength, bool* supported);
+
+  private:
+    /* Only touched by the actuator thread. */
+    std::unique_ptr<Actuator> mBackend;
+
+    std::atomic<uint8_t> mAmplitude{UINT8_MAX};
+    std::atomic<State> mState{State::IDLE};
+
+    /*
+     * Commands waiting for the actuator thread, kept in a ring so that binder
+     * threads never allocate. The actuator drains it whole on every wake-up.
+     */
+    static constexpr size_t QUEUE_MAX = 16;
+    std::mutex mQueueLock;
+    Command mQueue[QUEUE_MAX];
+    size_t mQueueHead{0};
+    size_t mQueueCount{0};
+
+    /* The commands taken off the ring in one go, owned by the actuator thread. */
+    Command mBatch[QUEUE_MAX];
+
+    /* Composition being played, owned by the actuator thread. */
+    SegmentList mSegments;
+    std::shared_ptr<IVibratorCallback> mCallback;
+    size_t mSegment{0};
+    struct timespec mSegmentEnd{};
+    /* The first drive is a prepared effect the backend is already playing. */
+    bool mPrepared{false};
+
+    /* Haptic PCM stream played while externally controlled. */
+    int mHapticListenFd{-1};
+    int mHapticFd{-1};
+    HapticEnvelope mHapticEnvelope;
+    bool mHapticDriving{false};
+    int64_t mHapticDriveEndMs{0};
+
+    /* Latency and energy accounting, updated by the actuator thread and read by dump(). */
+    EffectStats mStats[STATS_KINDS];
+    std::atomic<uint64_t> mOnTimeUs{0};
+    std::atomic<uint64_t> mEnergyMvUs{0};
+    size_t mPlayKind{STATS_ON};
+    int64_t mPlayEntryNs{0};
+    bool mPlayRecorded{true};
+    uint32_t mDriveMv{0};
+    int64_t mDriveStartNs{0};
+    int64_t mDriveEndNs{0};
+
+    int mWakeFd{-1};
+    int mTimerFd{-1};
+    std::thread mActuator;
 };
-}  // namespace implementation
-}  // namespace V1_3
+
 }  // namespace vibrator
 }  // namespace hardware
 }  // namespace android
-
-#endif  // ANDROID_HARDWARE_VIBRATOR_V1_3_VIBRATOR_H
+}  // namespace aidl
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VibratorStats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+int64_t nowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void LatencyHistogram::record(int64_t ns) {
+    uint64_t us = ns > 0 ? ns / 1000 : 0;
+    size_t bucket = 0;
+
+    while (us && bucket < BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::dump(int fd, const char* name) const {
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        uint64_t count = buckets[bucket].load(std::memory_order_relaxed);
+        if (!count) {
+            continue;
+        }
+
+        if (bucket == BUCKETS - 1) {
+            dprintf(fd, "      %-8s >= %6u us: %" PRIu64 "\n", name, 1u << (bucket - 1), count);
+        } else {
+            dprintf(fd, "      %-8s <  %6u us: %" PRIu64 "\n", name, 1u << bucket, count);
+        }
+    }
+}
+
+std::string statsKindName(size_t kind) {
+    switch (kind) {
+        case STATS_ON:
+            return "ON";
+        case STATS_COMPOSE:
+            return "COMPOSE";
+        case STATS_EXTERNAL:
+            return "EXTERNAL";
+    }
+    return toString(static_cast<Effect>(kind - STATS_EFFECT));
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
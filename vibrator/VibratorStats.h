@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <aidl/android/hardware/vibrator/BnVibrator.h>
+
+#include <atomic>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+int64_t nowNs();
+
+/*
+ * Histogram of actuation latency, bucket n counts samples that took
+ * [2^(n-1), 2^n) microseconds and the last bucket everything slower.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr size_t BUCKETS = 16;
+
+    void record(int64_t ns);
+    void dump(int fd, const char* name) const;
+
+  private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+};
+
+/* What a playback was started for, effects are indexed from STATS_EFFECT. */
+enum StatsKind : size_t {
+    STATS_ON,
+    STATS_COMPOSE,
+    STATS_EXTERNAL,
+    STATS_EFFECT,
+};
+
+static constexpr size_t STATS_KINDS = STATS_EFFECT + static_cast<size_t>(Effect::TEXTURE_TICK) + 1;
+
+std::string statsKindName(size_t kind);
+
+/*
+ * Latency from the binder call to each actuation stage, and how late the
+ * end of the playback was reported against its schedule.
+ */
+struct EffectStats {
+    std::atomic<uint64_t> count{0};
+    LatencyHistogram voltage;
+    LatencyHistogram activate;
+    LatencyHistogram end;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
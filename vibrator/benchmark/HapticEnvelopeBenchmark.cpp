@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the haptic envelope follower over a PCM fixture, in the packet sizes a
+ * client may send. The fixture is a synthesized tone burst, or the last
+ * channel of a 16-bit PCM WAV file given as the first non-benchmark argument.
+ * Besides the throughput, the burst reports how long the smoothed level takes
+ * to rise to and fall from it, which is what the motor ends up following.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "HapticEnvelope.h"
+
+using ::aidl::android::hardware::vibrator::blockLevel;
+using ::aidl::android::hardware::vibrator::HapticEnvelope;
+using ::aidl::android::hardware::vibrator::HAPTIC_ATTACK_MS;
+using ::aidl::android::hardware::vibrator::HAPTIC_RELEASE_MS;
+using ::aidl::android::hardware::vibrator::HAPTIC_SAMPLE_RATE;
+
+namespace {
+
+/* The synthesized fixture: silence, a full scale burst near the motor's resonance, silence. */
+static constexpr uint32_t kBurstStartMs = 200;
+static constexpr uint32_t kBurstMs = 300;
+static constexpr uint32_t kFixtureMs = 1000;
+static constexpr float kBurstHz = 170.0f;
+
+static std::vector<int16_t> burst;
+static std::vector<int16_t> fixture;
+
+static size_t msToSamples(uint32_t ms) {
+    return static_cast<size_t>(ms) * HAPTIC_SAMPLE_RATE / 1000;
+}
+
+static std::vector<int16_t> makeBurst() {
+    std::vector<int16_t> samples(msToSamples(kFixtureMs));
+    size_t start = msToSamples(kBurstStartMs);
+    size_t end = start + msToSamples(kBurstMs);
+
+    for (size_t i = start; i < end; i++) {
+        float phase = 2.0f * M_PI * kBurstHz * (i - start) / HAPTIC_SAMPLE_RATE;
+        samples[i] = static_cast<int16_t>(32767.0f * std::sin(phase));
+    }
+
+    return samples;
+}
+
+/* The last channel of a 16-bit PCM WAV file, where the haptic channel goes. */
+static bool readWav(const char* path, std::vector<int16_t>* samples) {
+    FILE* file = fopen(path, "rb");
+    char id[4];
+    uint32_t size;
+    uint16_t format = 0, channels = 0, bits = 0;
+    bool ok = false;
+
+    if (!file) {
+        return false;
+    }
+
+    if (fread(id, 1, 4, file) != 4 || memcmp(id, "RIFF", 4) ||
+        fread(&size, 4, 1, file) != 1 || fread(id, 1, 4, file) != 4 || memcmp(id, "WAVE", 4)) {
+        fclose(file);
+        return false;
+    }
+
+    while (fread(id, 1, 4, file) == 4 && fread(&size, 4, 1, file) == 1) {
+        if (!memcmp(id, "fmt ", 4) && size >= 16) {
+            uint8_t fmt[16];
+            if (fread(fmt, 1, 16, file) != 16) {
+                break;
+            }
+            memcpy(&format, fmt, 2);
+            memcpy(&channels, fmt + 2, 2);
+            memcpy(&bits, fmt + 14, 2);
+            fseek(file, size - 16 + (size & 1), SEEK_CUR);
+        } else if (!memcmp(id, "data", 4)) {
+            if (format != 1 || bits != 16 || channels == 0) {
+                break;
+            }
+
+            std::vector<int16_t> frames(size / sizeof(int16_t));
+            frames.resize(fread(frames.data(), sizeof(int16_t), frames.size(), file));
+            for (size_t i = channels - 1; i < frames.size(); i += channels) {
+                samples->push_back(frames[i]);
+            }
+            ok = !samples->empty();
+            break;
+        } else {
+            fseek(file, size + (size & 1), SEEK_CUR);
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+/* Feed samples in blocks of blockSize and keep the level after each block. */
+static std::vector<float> follow(const std::vector<int16_t>& samples, size_t blockSize) {
+    HapticEnvelope envelope(HAPTIC_SAMPLE_RATE, HAPTIC_ATTACK_MS, HAPTIC_RELEASE_MS);
+    std::vector<float> levels;
+
+    for (size_t i = 0; i < samples.size(); i += blockSize) {
+        levels.push_back(envelope.process(&samples[i], std::min(blockSize, samples.size() - i)));
+    }
+
+    return levels;
+}
+
+/* The mean rectified level of one block, the common part of every packet. */
+static void BM_BlockLevel(benchmark::State& state) {
+    size_t blockSize = state.range(0);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i + blockSize <= fixture.size(); i += blockSize) {
+            benchmark::DoNotOptimize(blockLevel(&fixture[i], blockSize));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * (fixture.size() / blockSize) * blockSize);
+}
+BENCHMARK(BM_BlockLevel)->Arg(48)->Arg(240)->Arg(960);
+
+/*
+ * The whole fixture through the follower, one packet of blockSize samples at
+ * a time. attack_ms is the audio time from the burst's start until the level
+ * reaches 90% of its settled value, the mean over the burst's second half,
+ * and release_ms from the burst's end until it falls under 10% of it. Both
+ * are quantized to the packet length.
+ */
+static void BM_EnvelopeStream(benchmark::State& state) {
+    size_t blockSize = state.range(0);
+    HapticEnvelope envelope(HAPTIC_SAMPLE_RATE, HAPTIC_ATTACK_MS, HAPTIC_RELEASE_MS);
+
+    for (auto _ : state) {
+        envelope.reset();
+        for (size_t i = 0; i < fixture.size(); i += blockSize) {
+            size_t count = std::min(blockSize, fixture.size() - i);
+            benchmark::DoNotOptimize(envelope.process(&fixture[i], count));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * fixture.size());
+
+    std::vector<float> levels = follow(burst, blockSize);
+    float blockMs = blockSize * 1000.0f / HAPTIC_SAMPLE_RATE;
+    size_t start = msToSamples(kBurstStartMs) / blockSize;
+    size_t end = msToSamples(kBurstStartMs + kBurstMs) / blockSize;
+    float settled = 0.0f;
+    size_t attack = start, release = end;
+
+    for (size_t i = (start + end) / 2; i < end; i++) {
+        settled += levels[i] / (end - (start + end) / 2);
+    }
+    while (attack < levels.size() && levels[attack] < 0.9f * settled) {
+        attack++;
+    }
+    while (release < levels.size() && levels[release] >= 0.1f * settled) {
+        release++;
+    }
+
+    state.counters["attack_ms"] = (attack + 1 - start) * blockMs;
+    state.counters["release_ms"] = (release + 1 - end) * blockMs;
+}
+BENCHMARK(BM_EnvelopeStream)->Arg(48)->Arg(240)->Arg(960);
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    burst = makeBurst();
+    fixture = burst;
+    if (argc > 1) {
+        fixture.clear();
+        if (!readWav(argv[1], &fixture)) {
+            fprintf(stderr, "%s is not a 16-bit PCM WAV file\n", argv[1]);
+            return 1;
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
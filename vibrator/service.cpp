@@ -13,34 +13,30 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#define LOG_TAG "android.hardware.vibrator@1.3-service.xiaomi_onclite"
+#define LOG_TAG "android.hardware.vibrator-service.xiaomi_onclite"
 
-#include <android/hardware/vibrator/1.3/IVibrator.h>
-#include <hidl/HidlTransportSupport.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <log/log.h>
 
 #include "Vibrator.h"
 
-using android::hardware::configureRpcThreadpool;
-using android::hardware::joinRpcThreadpool;
-using android::hardware::vibrator::V1_3::IVibrator;
-using android::hardware::vibrator::V1_3::implementation::Vibrator;
-using namespace android;
-
-status_t registerVibratorService() {
-    sp<IVibrator> vibrator = new Vibrator();
-
-    return vibrator->registerAsService();
-}
+using ::aidl::android::hardware::vibrator::Vibrator;
 
 int main() {
-    configureRpcThreadpool(1, true);
-    status_t status = registerVibratorService();
+    ABinderProcess_setThreadPoolMaxThreadCount(2);
+
+    std::shared_ptr<Vibrator> vibrator = ndk::SharedRefBase::make<Vibrator>();
 
-    if (status != OK) {
-        return status;
+    const std::string instance = std::string() + Vibrator::descriptor + "/default";
+    binder_status_t status =
+            AServiceManager_addService(vibrator->asBinder().get(), instance.c_str());
+    if (status != STATUS_OK) {
+        ALOGE("Cannot register Vibrator HAL service.");
+        return 1;
     }
 
-    joinRpcThreadpool();
+    ABinderProcess_joinThreadPool();
 
     return 1;
 }
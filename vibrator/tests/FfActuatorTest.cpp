@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Actuator.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+namespace {
+
+static constexpr uint32_t kEffectSlots = 16;
+static constexpr auto kTimeout = std::chrono::seconds(2);
+
+/* VMIN still vibrates, so it maps to the lowest non-zero magnitude. */
+static uint16_t expectedMagnitude(uint32_t mv) {
+    return 1 + (mv - QPNP_VIB_LDO_VMIN_MV) * 0xFFFE / MV_ADDITION_MAX;
+}
+
+/*
+ * A uinput force feedback device that accepts every upload and records what
+ * the kernel hands back to it: uploaded effects, and the gain and playback
+ * events written to the event node.
+ */
+class UinputFfDevice {
+  public:
+    ~UinputFfDevice() {
+        mRunning = false;
+        if (mServer.joinable()) {
+            mServer.join();
+        }
+        if (mFd >= 0) {
+            ioctl(mFd, UI_DEV_DESTROY);
+            close(mFd);
+        }
+    }
+
+    /* Returns the event node, or an empty string when uinput is not usable here. */
+    std::string create(bool hasGain) {
+        mFd = open("/dev/uinput", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (mFd < 0) {
+            return "";
+        }
+
+        struct uinput_setup setup = {};
+        strncpy(setup.name, "onclite-ff-test", sizeof(setup.name) - 1);
+        setup.id.bustype = BUS_VIRTUAL;
+        setup.ff_effects_max = kEffectSlots;
+
+        if (ioctl(mFd, UI_SET_EVBIT, EV_FF) < 0 || ioctl(mFd, UI_SET_FFBIT, FF_RUMBLE) < 0 ||
+            (hasGain && ioctl(mFd, UI_SET_FFBIT, FF_GAIN) < 0) ||
+            ioctl(mFd, UI_DEV_SETUP, &setup) < 0 || ioctl(mFd, UI_DEV_CREATE) < 0) {
+            return "";
+        }
+
+        /* Uploads block until they are answered, so serve before anyone opens the node. */
+        mRunning = true;
+        mServer = std::thread(&UinputFfDevice::serve, this);
+
+        return eventNode();
+    }
+
+    std::vector<struct ff_effect> uploads() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mUploads;
+    }
+
+    /* Wait for count EV_FF events written to the device, gain and playback alike. */
+    std::vector<struct input_event> waitForEvents(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCond.wait_for(lock, kTimeout, [&] { return mEvents.size() >= count; });
+        return mEvents;
+    }
+
+  private:
+    std::string eventNode() {
+        char sysname[64] = {};
+        if (ioctl(mFd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+            return "";
+        }
+
+        /* ueventd or udev creates the node shortly after the device registers. */
+        std::string sysDir = std::string("/sys/devices/virtual/input/") + sysname;
+        auto deadline = std::chrono::steady_clock::now() + kTimeout;
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(sysDir.c_str()), closedir);
+            while (struct dirent* entry = dir ? readdir(dir.get()) : nullptr) {
+                std::string node = std::string("/dev/input/") + entry->d_name;
+                if (!strncmp(entry->d_name, "event", 5) && !access(node.c_str(), R_OK | W_OK)) {
+                    return node;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return "";
+    }
+
+    void serve() {
+        struct pollfd pfd = {mFd, POLLIN, 0};
+        struct input_event event;
+
+        while (mRunning) {
+            if (poll(&pfd, 1, 20) <= 0) {
+                continue;
+            }
+            while (read(mFd, &event, sizeof(event)) == sizeof(event)) {
+                handle(event);
+            }
+        }
+    }
+
+    void handle(const struct input_event& event) {
+        if (event.type == EV_UINPUT && event.code == UI_FF_UPLOAD) {
+            struct uinput_ff_upload upload = {};
+            upload.request_id = event.value;
+            ioctl(mFd, UI_BEGIN_FF_UPLOAD, &upload);
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mUploads.push_back(upload.effect);
+            }
+            upload.retval = 0;
+            ioctl(mFd, UI_END_FF_UPLOAD, &upload);
+        } else if (event.type == EV_UINPUT && event.code == UI_FF_ERASE) {
+            struct uinput_ff_erase erase = {};
+            erase.request_id = event.value;
+            ioctl(mFd, UI_BEGIN_FF_ERASE, &erase);
+            erase.retval = 0;
+            ioctl(mFd, UI_END_FF_ERASE, &erase);
+        } else if (event.type == EV_FF) {
+            std::lock_guard<std::mutex> lock(mLock);
+            mEvents.push_back(event);
+            mCond.notify_all();
+        }
+    }
+
+    int mFd{-1};
+    std::atomic<bool> mRunning{false};
+    std::thread mServer;
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<struct ff_effect> mUploads;
+    std::vector<struct input_event> mEvents;
+};
+
+/* A directory to probe that holds nothing but a link to the test device, if any. */
+class ProbeDir {
+  public:
+    ProbeDir() {
+        char path[] = "/tmp/ff-actuator-test-XXXXXX";
+        if (mkdtemp(path)) {
+            mPath = std::string(path) + "/";
+        }
+    }
+
+    ~ProbeDir() {
+        if (!mLink.empty()) {
+            unlink(mLink.c_str());
+        }
+        if (!mPath.empty()) {
+            rmdir(mPath.c_str());
+        }
+    }
+
+    bool link(const std::string& node) {
+        mLink = mPath + "event0";
+        return symlink(node.c_str(), mLink.c_str()) == 0;
+    }
+
+    const std::string& path() const { return mPath; }
+
+  private:
+    std::string mPath;
+    std::string mLink;
+};
+
+class FfActuatorTest : public ::testing::TestWithParam<bool> {
+  protected:
+    void SetUp() override {
+        std::string node = mDevice.create(hasGain());
+        if (node.empty()) {
+            GTEST_SKIP() << "uinput force feedback is not available";
+        }
+        ASSERT_FALSE(mDir.path().empty());
+        ASSERT_TRUE(mDir.link(node));
+
+        mActuator = FfActuator::probe(mEffects, mDir.path());
+        ASSERT_NE(mActuator, nullptr);
+    }
+
+    void TearDown() override {
+        /* Closing the node erases the effects, which the device still has to answer. */
+        mActuator.reset();
+    }
+
+    bool hasGain() const { return GetParam(); }
+
+    /* The drive slot, then one slot per effect in map order. */
+    int16_t slotId(size_t index) { return mDevice.uploads().at(index).id; }
+
+    /* Long enough for the level of a playing effect to be changed from the test. */
+    const std::map<Effect, uint32_t> mEffects = {
+            {Effect::CLICK, 500},
+            {Effect::TICK, 5},
+    };
+    UinputFfDevice mDevice;
+    ProbeDir mDir;
+    std::unique_ptr<FfActuator> mActuator;
+};
+
+TEST_P(FfActuatorTest, UploadsEffectsOnProbe) {
+    std::vector<struct ff_effect> uploads = mDevice.uploads();
+
+    EXPECT_STREQ(mActuator->name(), "ff");
+    ASSERT_EQ(uploads.size(), 1 + mEffects.size());
+
+    /* The drive slot is reserved first, at full strength. */
+    EXPECT_EQ(uploads[0].type, FF_RUMBLE);
+    EXPECT_EQ(uploads[0].u.rumble.strong_magnitude, 0xFFFF);
+
+    size_t index = 1;
+    for (const auto& [effect, ms] : mEffects) {
+        EXPECT_EQ(uploads[index].type, FF_RUMBLE) << toString(effect);
+        EXPECT_EQ(uploads[index].replay.length, ms) << toString(effect);
+        EXPECT_EQ(uploads[index].u.rumble.strong_magnitude, 0xFFFF) << toString(effect);
+        for (size_t other = 0; other < index; other++) {
+            EXPECT_NE(uploads[index].id, uploads[other].id) << toString(effect);
+        }
+        index++;
+    }
+}
+
+TEST_P(FfActuatorTest, ReusesDriveSlot) {
+    size_t probed = mDevice.uploads().size();
+    int16_t driveId = slotId(0);
+
+    ASSERT_TRUE(mActuator->drive(QPNP_VIB_LDO_VMAX_MV, 50));
+    ASSERT_TRUE(mActuator->drive(QPNP_VIB_LDO_VMAX_MV, 80));
+
+    std::vector<struct ff_effect> uploads = mDevice.uploads();
+    ASSERT_EQ(uploads.size(), probed + 2);
+    EXPECT_EQ(uploads[probed].id, driveId);
+    EXPECT_EQ(uploads[probed].replay.length, 50);
+    EXPECT_EQ(uploads[probed + 1].id, driveId);
+    EXPECT_EQ(uploads[probed + 1].replay.length, 80);
+
+    std::vector<struct input_event> events = mDevice.waitForEvents(2);
+    ASSERT_EQ(events.size(), 2u);
+    for (const struct input_event& event : events) {
+        EXPECT_EQ(event.code, driveId);
+        EXPECT_EQ(event.value, 1);
+    }
+}
+
+TEST_P(FfActuatorTest, SetsLevel) {
+    const uint32_t mv = (QPNP_VIB_LDO_VMIN_MV + QPNP_VIB_LDO_VMAX_MV) / 2;
+    size_t probed = mDevice.uploads().size();
+    int16_t driveId = slotId(0);
+
+    ASSERT_TRUE(mActuator->drive(mv, 20));
+
+    if (!hasGain()) {
+        /* Without FF_GAIN the level goes into the effect itself. */
+        std::vector<struct ff_effect> uploads = mDevice.uploads();
+        ASSERT_EQ(uploads.size(), probed + 1);
+        EXPECT_EQ(uploads[probed].u.rumble.strong_magnitude, expectedMagnitude(mv));
+
+        std::vector<struct input_event> events = mDevice.waitForEvents(1);
+        ASSERT_EQ(events.size(), 1u);
+        EXPECT_EQ(events[0].code, driveId);
+        return;
+    }
+
+    /* The gain arrives ahead of the playback, and only when it changes. */
+    ASSERT_TRUE(mActuator->drive(mv, 20));
+    ASSERT_TRUE(mActuator->setVoltage(QPNP_VIB_LDO_VMAX_MV));
+
+    std::vector<struct input_event> events = mDevice.waitForEvents(4);
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events[0].code, FF_GAIN);
+    EXPECT_EQ(events[0].value, expectedMagnitude(mv));
+    EXPECT_EQ(events[1].code, driveId);
+    EXPECT_EQ(events[2].code, driveId);
+    EXPECT_EQ(events[3].code, FF_GAIN);
+    EXPECT_EQ(events[3].value, 0xFFFF);
+}
+
+TEST_P(FfActuatorTest, DrivesAtVmin) {
+    size_t probed = mDevice.uploads().size();
+
+    ASSERT_TRUE(mActuator->drive(QPNP_VIB_LDO_VMIN_MV, 20));
+
+    if (!hasGain()) {
+        std::vector<struct ff_effect> uploads = mDevice.uploads();
+        ASSERT_EQ(uploads.size(), probed + 1);
+        EXPECT_EQ(uploads[probed].u.rumble.strong_magnitude, 1);
+        return;
+    }
+
+    std::vector<struct input_event> events = mDevice.waitForEvents(2);
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].code, FF_GAIN);
+    EXPECT_EQ(events[0].value, 1);
+}
+
+TEST_P(FfActuatorTest, PlaysPreparedEffects) {
+    int16_t clickId = slotId(1);
+    size_t probed = mDevice.uploads().size();
+
+    ASSERT_TRUE(mActuator->playEffect(Effect::CLICK, QPNP_VIB_LDO_VMAX_MV));
+    EXPECT_FALSE(mActuator->playEffect(Effect::THUD, QPNP_VIB_LDO_VMAX_MV));
+
+    /* A prepared effect plays without another upload. */
+    EXPECT_EQ(mDevice.uploads().size(), probed);
+
+    std::vector<struct input_event> events = mDevice.waitForEvents(1);
+    ASSERT_FALSE(events.empty());
+    EXPECT_EQ(events.back().code, clickId);
+    EXPECT_EQ(events.back().value, 1);
+}
+
+/* The level of a playing prepared effect follows the sustain level, with or without FF_GAIN. */
+TEST_P(FfActuatorTest, ChangesLevelOfPreparedEffect) {
+    const uint32_t mv = (QPNP_VIB_LDO_VMIN_MV + QPNP_VIB_LDO_VMAX_MV) / 2;
+    int16_t driveId = slotId(0);
+    int16_t clickId = slotId(1);
+    size_t probed = mDevice.uploads().size();
+
+    /* Without FF_GAIN a prepared effect only plays at full strength. */
+    EXPECT_EQ(mActuator->playEffect(Effect::CLICK, mv), hasGain());
+    mActuator->stop();
+    mDevice.waitForEvents(hasGain() ? 3 : 0);
+
+    ASSERT_TRUE(mActuator->playEffect(Effect::CLICK, QPNP_VIB_LDO_VMAX_MV));
+    ASSERT_TRUE(mActuator->setVoltage(mv));
+
+    std::vector<struct input_event> events = mDevice.waitForEvents(hasGain() ? 6 : 2);
+    ASSERT_GE(events.size(), 2u);
+
+    if (hasGain()) {
+        ASSERT_EQ(events.size(), 6u);
+        EXPECT_EQ(events[3].code, FF_GAIN);
+        EXPECT_EQ(events[3].value, 0xFFFF);
+        EXPECT_EQ(events[4].code, clickId);
+        EXPECT_EQ(events[5].code, FF_GAIN);
+        EXPECT_EQ(events[5].value, expectedMagnitude(mv));
+        EXPECT_EQ(mDevice.uploads().size(), probed);
+        return;
+    }
+
+    /* The drive slot takes over at the new level for the rest of the effect. */
+    std::vector<struct ff_effect> uploads = mDevice.uploads();
+    ASSERT_EQ(uploads.size(), probed + 1);
+    EXPECT_EQ(uploads[probed].id, driveId);
+    EXPECT_EQ(uploads[probed].u.rumble.strong_magnitude, expectedMagnitude(mv));
+    EXPECT_GT(uploads[probed].replay.length, 0);
+    EXPECT_LE(uploads[probed].replay.length, 500);
+
+    events = mDevice.waitForEvents(2);
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].code, clickId);
+    EXPECT_EQ(events[1].code, driveId);
+}
+
+INSTANTIATE_TEST_SUITE_P(Gain, FfActuatorTest, ::testing::Bool(),
+                         [](const auto& info) { return info.param ? "FfGain" : "NoFfGain"; });
+
+TEST(ProbeActuatorTest, FallsBackToLeds) {
+    ProbeDir dir;
+
+    ASSERT_FALSE(dir.path().empty());
+    EXPECT_EQ(FfActuator::probe({{Effect::CLICK, 10}}, dir.path()), nullptr);
+
+    std::unique_ptr<Actuator> actuator = probeActuator({{Effect::CLICK, 10}}, dir.path());
+    ASSERT_NE(actuator, nullptr);
+    EXPECT_STREQ(actuator->name(), "leds");
+}
+
+}  // anonymous namespace
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl